@@ -0,0 +1,423 @@
+#pragma once
+
+#include "Subscription.h"
+
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <functional>
+#include <algorithm>
+#include <initializer_list>
+#include <typeindex>
+#include <typeinfo>
+#include <type_traits>
+#include <cstddef>
+#include <cstdint>
+
+
+// Events for one field of T, indexed by the filter predicates on that field. A field is anything std::invoke can read from a
+// const T &: a data member pointer, a const member function pointer or a captureless lambda. Its value has to be hashable
+// and ordered.
+template <typename T>
+class EventFieldIndexBase {
+public:
+	virtual ~EventFieldIndexBase() {}
+
+	// Appends the entries indexed by a predicate on this field that holds for the event.
+	virtual void collectCandidates(const T & event, std::vector<std::uint32_t> & candidates) = 0;
+
+	virtual std::size_t getMemoryFootprint() const = 0;
+};
+
+template <typename T, auto field>
+class EventFieldIndex : public EventFieldIndexBase<T> {
+public:
+	typedef std::decay_t<std::invoke_result_t<decltype(field), const T &>> Value;
+
+private:
+	struct Range {
+		Value low;
+		Value high;
+		std::uint32_t entry;
+		Value maxHigh; 	// Highest 'high' of the ranges in the subtree this range is the root of.
+	};
+
+	std::unordered_map<Value, std::vector<std::uint32_t>> equalTo;
+
+	// Sorted by 'low' and read as an implicit binary search tree, the middle range of each span being the root of that span, with
+	// each root knowing how far the ranges below it reach. A lookup skips the subtrees that end before the value and stops at the
+	// ranges starting after it: O(log n) per range found, instead of looking at every range starting at or below the value.
+	std::vector<Range> ranges;
+	bool rangesIndexed = true; 	// False after addRange(); the ranges are sorted and their tree built on the next lookup.
+
+public:
+	void addEqualTo(const Value & value, std::uint32_t entry) {
+		equalTo[value].push_back(entry);
+	}
+
+	void addRange(const Value & low, const Value & high, std::uint32_t entry) {
+		ranges.push_back(Range{low, high, entry, high});
+		rangesIndexed = false;
+	}
+
+	void collectCandidates(const T & event, std::vector<std::uint32_t> & candidates) override {
+		const Value & value = std::invoke(field, event);
+
+		if (!equalTo.empty()) {
+			auto equalToIterator = equalTo.find(value);
+			if (equalToIterator != equalTo.end()) {
+				candidates.insert(candidates.end(), equalToIterator->second.begin(), equalToIterator->second.end());
+			}
+		}
+
+		if (!ranges.empty()) {
+			if (!rangesIndexed) {
+				_indexRanges();
+			}
+			_collectRanges(0, ranges.size(), value, candidates);
+		}
+	}
+
+	std::size_t getMemoryFootprint() const override {
+		std::size_t footprint = sizeof(*this);
+		footprint += equalTo.bucket_count() * sizeof(void*);
+		for (auto & [value, entries] : equalTo) {
+			footprint += sizeof(std::pair<const Value, std::vector<std::uint32_t>>) + sizeof(void*); 	// Node.
+			footprint += entries.capacity() * sizeof(std::uint32_t);
+		}
+		footprint += ranges.capacity() * sizeof(Range);
+		return footprint;
+	}
+
+private:
+	void _indexRanges() {
+		// Stable, so ranges starting at the same value keep the order they were added in.
+		std::stable_sort(
+			ranges.begin(),
+			ranges.end(),
+			[](const Range & lhs, const Range & rhs) {
+				return lhs.low < rhs.low;
+			}
+		);
+		_indexMaxHigh(0, ranges.size());
+		rangesIndexed = true;
+	}
+
+	// Fills in 'maxHigh' for the subtree of ranges[begin, end); returns its root.
+	std::size_t _indexMaxHigh(std::size_t begin, std::size_t end) {
+		std::size_t middle = begin + (end - begin) / 2;
+		Range & root = ranges[middle];
+		root.maxHigh = root.high;
+		if (begin < middle) {
+			const Value & leftMaxHigh = ranges[_indexMaxHigh(begin, middle)].maxHigh;
+			if (root.maxHigh < leftMaxHigh) {
+				root.maxHigh = leftMaxHigh;
+			}
+		}
+		if (middle + 1 < end) {
+			const Value & rightMaxHigh = ranges[_indexMaxHigh(middle + 1, end)].maxHigh;
+			if (root.maxHigh < rightMaxHigh) {
+				root.maxHigh = rightMaxHigh;
+			}
+		}
+		return middle;
+	}
+
+	// In order, so candidates come out sorted by 'low' like the ranges.
+	void _collectRanges(std::size_t begin, std::size_t end, const Value & value, std::vector<std::uint32_t> & candidates) const {
+		if (begin >= end) {
+			return;
+		}
+		std::size_t middle = begin + (end - begin) / 2;
+		const Range & root = ranges[middle];
+		if (root.maxHigh < value) {
+			return; 	// All of them end before the value.
+		}
+		_collectRanges(begin, middle, value, candidates);
+		if (value < root.low) {
+			return; 	// This one, and all to the right of it, start after the value.
+		}
+		if (!(root.high < value)) {
+			candidates.push_back(root.entry);
+		}
+		_collectRanges(middle + 1, end, value, candidates);
+	}
+};
+
+
+// One condition of an EventFilter<T>; knows which field index it goes into.
+template <typename T>
+class EventFilterPredicate {
+public:
+	virtual ~EventFilterPredicate() {}
+
+	virtual bool holds(const T & event) const = 0;
+	virtual bool isRange() const = 0;
+
+	virtual std::type_index getField() const = 0;
+	virtual std::unique_ptr<EventFieldIndexBase<T>> makeFieldIndex() const = 0;
+	virtual void addTo(EventFieldIndexBase<T> & fieldIndex, std::uint32_t entry) const = 0;
+};
+
+template <typename T, auto field>
+class EventFieldPredicate : public EventFilterPredicate<T> {
+public:
+	typedef typename EventFieldIndex<T, field>::Value Value;
+
+private:
+	std::vector<Value> values; 	// Any of these, for equals() and in(); sorted.
+	bool range;
+	Value low;
+	Value high;
+
+public:
+	EventFieldPredicate(std::vector<Value> values) :
+			values(std::move(values)),
+			range(false),
+			low(),
+			high()
+	{
+		// Each value counts once towards the match, even if it was passed twice.
+		std::sort(this->values.begin(), this->values.end());
+		this->values.erase(std::unique(this->values.begin(), this->values.end()), this->values.end());
+	}
+
+	EventFieldPredicate(const Value & low, const Value & high) :
+			range(true),
+			low(low),
+			high(high)
+	{
+	}
+
+	bool holds(const T & event) const override {
+		const Value & value = std::invoke(field, event);
+		if (range) {
+			return !(value < low) && !(high < value);
+		}
+		return std::binary_search(values.begin(), values.end(), value);
+	}
+
+	bool isRange() const override {
+		return range;
+	}
+
+	std::type_index getField() const override {
+		return std::type_index(typeid(EventFieldIndex<T, field>));
+	}
+
+	std::unique_ptr<EventFieldIndexBase<T>> makeFieldIndex() const override {
+		return std::make_unique<EventFieldIndex<T, field>>();
+	}
+
+	void addTo(EventFieldIndexBase<T> & fieldIndex, std::uint32_t entry) const override {
+		EventFieldIndex<T, field> & _fieldIndex = static_cast<EventFieldIndex<T, field> &>(fieldIndex);
+		if (range) {
+			_fieldIndex.addRange(low, high, entry);
+		} else {
+			for (const Value & value : values) {
+				_fieldIndex.addEqualTo(value, entry);
+			}
+		}
+	}
+};
+
+
+// Declarative conditions on the fields of T; an event matches when all of them hold.
+//
+//	EventFilter<InputEvent>().equals<&InputEvent::getDevice>(2).inRange<&InputEvent::getX>(0, 639)
+//
+// See EventManager<T>::subscribeFiltered().
+template <typename T>
+class EventFilter {
+private:
+	std::vector<std::shared_ptr<const EventFilterPredicate<T>>> predicates;
+
+public:
+	template<auto field, typename Value>
+	EventFilter<T> & equals(const Value & value) {
+		typedef typename EventFieldPredicate<T, field>::Value FieldValue;
+		predicates.push_back(std::make_shared<EventFieldPredicate<T, field>>(std::vector<FieldValue>{FieldValue(value)}));
+		return *this;
+	}
+
+	// Inclusive on both ends.
+	template<auto field, typename Value>
+	EventFilter<T> & inRange(const Value & low, const Value & high) {
+		typedef typename EventFieldPredicate<T, field>::Value FieldValue;
+		predicates.push_back(std::make_shared<EventFieldPredicate<T, field>>(FieldValue(low), FieldValue(high)));
+		return *this;
+	}
+
+	template<auto field, typename Value>
+	EventFilter<T> & in(std::initializer_list<Value> values) {
+		typedef typename EventFieldPredicate<T, field>::Value FieldValue;
+		predicates.push_back(std::make_shared<EventFieldPredicate<T, field>>(std::vector<FieldValue>(values.begin(), values.end())));
+		return *this;
+	}
+
+	const std::vector<std::shared_ptr<const EventFilterPredicate<T>>> & getPredicates() const {
+		return predicates;
+	}
+};
+
+
+// The filtered subscriptions of an event type, indexed per field. Each subscription is indexed by one of its predicates, an
+// equals() or in() one if it has any, and its other predicates are only checked once that one holds. Finding the subscriptions
+// for an event costs a hash lookup per indexed field, O(log n) per candidate found in a range, plus checking the candidates;
+// the other subscriptions aren't looked at.
+// Only touched by the thread managing events.
+template <typename T>
+class EventFilterIndex {
+private:
+	struct Entry {
+		std::shared_ptr<Subscription<T>> subscription;
+		EventFilter<T> filter; 	// Kept to rebuild the index without the invalid entries.
+		const EventFilterPredicate<T> * indexedPredicate; 	// Holds for each event the index finds this entry for; nullptr if the filter is empty.
+		bool invalid; 	// Found to be invalid; skipped until the rebuild.
+	};
+
+	std::vector<Entry> entries;
+	std::vector<std::unique_ptr<EventFieldIndexBase<T>>> fieldIndices;
+	std::unordered_map<std::type_index, std::size_t> fieldIndexPositions;
+	std::vector<std::uint32_t> unfilteredEntries; 	// Entries with an empty filter; they get every event.
+
+	std::vector<std::uint32_t> candidates; 	// Reused for every event.
+	std::size_t invalidEntryCount = 0; 	// Invalid entries run into since the last rebuild.
+	std::size_t rebuiltEntryCount = 0; 	// Entries right after the last rebuild.
+
+	static constexpr std::size_t minimumRebuildEntryCount = 32;
+
+public:
+	void add(const EventFilter<T> & filter, std::shared_ptr<Subscription<T>> subscription) {
+		// Invalid entries are only run into when they match; so also sweep them whenever the index doubled since the last
+		// rebuild, or those that never match would pile up. Amortized, that's O(1) validity checks per add.
+		if (entries.size() >= 2 * std::max(rebuiltEntryCount, minimumRebuildEntryCount)) {
+			removeInvalid();
+		}
+		_add(filter, std::move(subscription));
+	}
+
+	bool empty() const {
+		return entries.empty();
+	}
+
+	// Calls 'deliver' with each valid subscription whose filter matches the event.
+	template<typename Deliver>
+	void forEachMatch(const T & event, Deliver && deliver) {
+		if (entries.empty()) {
+			return;
+		}
+
+		for (std::uint32_t entryIndex : unfilteredEntries) {
+			_deliverIfValid(entries[entryIndex], deliver);
+		}
+
+		// The indexed predicate of each candidate holds; check the others.
+		candidates.clear();
+		for (auto & fieldIndex : fieldIndices) {
+			fieldIndex->collectCandidates(event, candidates);
+		}
+		for (std::uint32_t entryIndex : candidates) {
+			Entry & entry = entries[entryIndex];
+			bool matches = true;
+			for (const auto & predicate : entry.filter.getPredicates()) {
+				if (predicate.get() != entry.indexedPredicate && !predicate->holds(event)) {
+					matches = false;
+					break;
+				}
+			}
+			if (matches) {
+				_deliverIfValid(entry, deliver);
+			}
+		}
+
+		// Invalid entries are only found when they match; rebuild once they make up half of the index.
+		if (invalidEntryCount > 0 && 2 * invalidEntryCount >= entries.size()) {
+			removeInvalid();
+		}
+	}
+
+	void removeInvalid() {
+		// Built anew, so the rebuilt index only takes the memory it needs now.
+		std::vector<Entry> _entries;
+		std::swap(entries, _entries);
+		fieldIndices = std::vector<std::unique_ptr<EventFieldIndexBase<T>>>();
+		fieldIndexPositions = std::unordered_map<std::type_index, std::size_t>();
+		unfilteredEntries = std::vector<std::uint32_t>();
+		invalidEntryCount = 0;
+
+		for (Entry & _entry : _entries) {
+			if (_entry.subscription->isValid()) {
+				_add(_entry.filter, std::move(_entry.subscription));
+			}
+		}
+		rebuiltEntryCount = entries.size();
+	}
+
+	std::size_t getMemoryFootprint() const {
+		std::size_t footprint = 0;
+		footprint += entries.capacity() * sizeof(Entry);
+		for (const Entry & entry : entries) {
+			footprint += entry.filter.getPredicates().capacity() * sizeof(std::shared_ptr<const EventFilterPredicate<T>>);
+		}
+		for (const auto & fieldIndex : fieldIndices) {
+			footprint += fieldIndex->getMemoryFootprint();
+		}
+		footprint += fieldIndices.capacity() * sizeof(std::unique_ptr<EventFieldIndexBase<T>>);
+		if (!fieldIndexPositions.empty()) {
+			footprint += fieldIndexPositions.bucket_count() * sizeof(void*) + fieldIndexPositions.size() * (sizeof(std::pair<const std::type_index, std::size_t>) + sizeof(void*));
+		}
+		footprint += (unfilteredEntries.capacity() + candidates.capacity()) * sizeof(std::uint32_t);
+		return footprint;
+	}
+
+	// Drops the invalid entries and builds the index anew at its current size.
+	void compact() {
+		removeInvalid();
+		candidates.clear();
+		candidates.shrink_to_fit();
+	}
+
+private:
+	void _add(const EventFilter<T> & filter, std::shared_ptr<Subscription<T>> subscription) {
+		std::uint32_t entryIndex = static_cast<std::uint32_t>(entries.size());
+		entries.push_back(Entry{std::move(subscription), filter, nullptr, false});
+		_index(entryIndex);
+	}
+
+	void _index(std::uint32_t entryIndex) {
+		Entry & entry = entries[entryIndex];
+		if (entry.filter.getPredicates().empty()) {
+			unfilteredEntries.push_back(entryIndex);
+			return;
+		}
+
+		// Either index finds exactly the entries its predicate matches; the hash lookup of an equals() or in() is the cheaper one
+		// though, the ranges cost O(log n) per entry found in their interval tree (see _collectRanges()).
+		entry.indexedPredicate = entry.filter.getPredicates().front().get();
+		for (const auto & predicate : entry.filter.getPredicates()) {
+			if (!predicate->isRange()) {
+				entry.indexedPredicate = predicate.get();
+				break;
+			}
+		}
+
+		auto [positionIterator, inserted] = fieldIndexPositions.try_emplace(entry.indexedPredicate->getField(), fieldIndices.size());
+		if (inserted) {
+			fieldIndices.push_back(entry.indexedPredicate->makeFieldIndex());
+		}
+		entry.indexedPredicate->addTo(*fieldIndices[positionIterator->second], entryIndex);
+	}
+
+	template<typename Deliver>
+	void _deliverIfValid(Entry & entry, Deliver & deliver) {
+		if (!entry.subscription->isValid()) {
+			if (!entry.invalid) {
+				entry.invalid = true;
+				invalidEntryCount++;
+			}
+			return;
+		}
+		deliver(entry.subscription);
+	}
+};
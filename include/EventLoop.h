@@ -0,0 +1,198 @@
+#pragma once
+
+#include "ProcessManager.h"
+#include "EventTracer.h"
+
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+
+// The part of an EventLoop other threads hand calls to. Shared with whoever may still deliver to the loop, so it outlives the
+// loop; once the loop is gone it is closed, and whatever is handed to it is dropped.
+class EventLoopInbox {
+	friend class EventLoop;
+
+private:
+	std::vector<std::function<void(void)>> calls;
+	std::mutex mutex;
+	std::condition_variable condition;
+	bool closed = false;
+};
+
+
+class EventLoop {
+private:
+	// Only ever touched by the thread owning this loop; no lock needed.
+	std::vector<std::function<void(void)>> localQueue;
+	std::vector<std::function<void(void)>> _localQueue; 	// Spare buffer, swapped with 'localQueue' when running so its capacity is reused.
+
+	// Filled by other threads; handed off in batches.
+	std::shared_ptr<EventLoopInbox> inbox;
+	std::vector<std::function<void(void)>> _inbox; 	// Spare buffer, swapped with the inbox calls when running so its capacity is reused.
+
+	static inline thread_local EventLoop * currentEventLoop = nullptr;
+
+	// Deliveries to other threads' loops made while handling ProcessManager requests on this thread; handed off in one go per loop
+	// at the end of each pass over the requests, so they keep flowing while the requests never run out.
+	struct OutgoingBatch {
+		std::shared_ptr<EventLoopInbox> eventLoopInbox; 	// Keeps the key valid until the batch is handed off.
+		std::vector<std::function<void(void)>> calls;
+	};
+	static inline thread_local std::unordered_map<EventLoopInbox *, OutgoingBatch> outgoingBatches;
+	static inline thread_local bool outgoingFlushRequested = false;
+
+public:
+	// The loop is bound to the thread constructing it; subscriptions made on that thread are delivered through this loop.
+	EventLoop() :
+			inbox(std::make_shared<EventLoopInbox>())
+	{
+		currentEventLoop = this;
+	}
+
+	~EventLoop() {
+		if (currentEventLoop == this) {
+			currentEventLoop = nullptr;
+		}
+
+		// Subscriptions on this loop may outlive it; what is delivered to them from now on is dropped, as is what is still waiting.
+		inbox->mutex.lock();
+		inbox->closed = true;
+		std::swap(inbox->calls, _inbox);
+		inbox->mutex.unlock();
+	}
+
+	EventLoop(const EventLoop &) = delete;
+	EventLoop & operator=(const EventLoop &) = delete;
+
+	static EventLoop * current() {
+		return currentEventLoop;
+	}
+
+	// Inbox of the loop of the calling thread; empty if it has none.
+	static std::weak_ptr<EventLoopInbox> currentInbox() {
+		if (currentEventLoop == nullptr) {
+			return std::weak_ptr<EventLoopInbox>();
+		}
+		return currentEventLoop->inbox;
+	}
+
+	bool isCurrent() const {
+		return currentEventLoop == this;
+	}
+
+	template<typename Func, typename... Bindables>
+	void post(Func func, Bindables... bindables) {
+		postTo(inbox, func, bindables...);
+	}
+
+	// Like post(), to the loop owning 'eventLoopInbox'; dropped if that loop is gone.
+	template<typename Func, typename... Bindables>
+	static void postTo(const std::weak_ptr<EventLoopInbox> & eventLoopInbox, Func func, Bindables... bindables) {
+		// Bind the arguments to make a simple void(void) function call.
+		std::function<void(void)> callbackFunction = std::bind(func, bindables...);
+#ifdef EVENTHANDLING_TRACING
+		// Trace the hop over to this loop as a flow of its own, starting in the dispatch that posts it.
+		callbackFunction = [flowID = EventTracer::publish("loop"), callbackFunction = std::move(callbackFunction)]() {
+			EventTracer::DispatchScope dispatchScope("loop", flowID);
+			callbackFunction();
+		};
+#endif
+
+		if (currentEventLoop != nullptr && currentEventLoop->_hasInbox(eventLoopInbox)) {
+			// Own thread; nobody else touches the local queue.
+			currentEventLoop->localQueue.push_back(std::move(callbackFunction));
+			return;
+		}
+
+		std::shared_ptr<EventLoopInbox> _eventLoopInbox = eventLoopInbox.lock();
+		if (!_eventLoopInbox) {
+			return;
+		}
+
+		if (ProcessManager::isHandlingProcessRequests()) {
+			// Stage it; everything staged for this loop is handed off in one go when the pass ends.
+			OutgoingBatch & outgoingBatch = outgoingBatches[_eventLoopInbox.get()];
+			if (!outgoingBatch.eventLoopInbox) {
+				outgoingBatch.eventLoopInbox = std::move(_eventLoopInbox);
+			}
+			outgoingBatch.calls.push_back(std::move(callbackFunction));
+			if (!outgoingFlushRequested) {
+				outgoingFlushRequested = true;
+				ProcessManager::requestProcessAtPassEnd(&EventLoop::flushOutgoingBatches);
+			}
+		} else {
+			// Not draining; nothing to batch with, hand it off right away.
+			std::vector<std::function<void(void)>> batch;
+			batch.push_back(std::move(callbackFunction));
+			_handOff(*_eventLoopInbox, batch);
+		}
+	}
+
+	static void flushOutgoingBatches() {
+		outgoingFlushRequested = false;
+		for (auto & [_eventLoopInbox, outgoingBatch] : outgoingBatches) {
+			_handOff(*outgoingBatch.eventLoopInbox, outgoingBatch.calls);
+		}
+		// Erased once flushed; an entry left behind would keep the inbox of a loop that may be gone by the next pass.
+		outgoingBatches.clear();
+	}
+
+	// Must be called from the thread owning this loop.
+	void run() {
+		// Take the whole inbox in one lock.
+		inbox->mutex.lock();
+		std::swap(inbox->calls, _inbox);
+		inbox->mutex.unlock();
+
+		for (auto & _inboxCall : _inbox) {
+			_inboxCall();
+		}
+		_inbox.clear();
+
+		// Local deliveries; calls made here may post to the local queue again, so keep going until it is empty.
+		while (!localQueue.empty()) {
+			std::swap(localQueue, _localQueue);
+			for (auto & _localCall : _localQueue) {
+				_localCall();
+			}
+			_localQueue.clear();
+		}
+	}
+
+	// Must be called from the thread owning this loop. Returns early when another thread hands off events.
+	template<typename Rep, typename Period>
+	void waitForEvents(const std::chrono::duration<Rep, Period> & timeout) {
+		if (!localQueue.empty()) {
+			return;
+		}
+		std::unique_lock<std::mutex> lock(inbox->mutex);
+		inbox->condition.wait_for(lock, timeout, [this](){ return !inbox->calls.empty(); });
+	}
+
+private:
+	bool _hasInbox(const std::weak_ptr<EventLoopInbox> & eventLoopInbox) const {
+		// Compares ownership, so it doesn't lock the weak_ptr, nor mistake a new inbox at a dead one's address for it.
+		return !inbox.owner_before(eventLoopInbox) && !eventLoopInbox.owner_before(inbox);
+	}
+
+	static void _handOff(EventLoopInbox & eventLoopInbox, std::vector<std::function<void(void)>> & batch) {
+		eventLoopInbox.mutex.lock();
+		if (eventLoopInbox.closed) {
+			eventLoopInbox.mutex.unlock();
+			batch.clear();
+			return;
+		} else if (eventLoopInbox.calls.empty()) {
+			std::swap(eventLoopInbox.calls, batch);
+		} else {
+			std::move(batch.begin(), batch.end(), std::back_inserter(eventLoopInbox.calls));
+		}
+		eventLoopInbox.mutex.unlock();
+		batch.clear();
+		eventLoopInbox.condition.notify_one();
+	}
+};
@@ -1,17 +1,33 @@
 #pragma once
 
 #include "Key.h"
+#include "KeyId.h"
+#include "EventLoop.h"
 #include "Subscription.h"
 #include "SubscriptionHandle.h"
 #include "ProcessManager.h"
 #include "Phase.h"
 #include "PhaseManager.h"
+#include "EventTypeRegistry.h"
+#include "PoolAllocator.h"
+#include "EventTracer.h"
+#include "EventToken.h"
+#include "EventPayloadPool.h"
+#include "EventFilter.h"
 
 #include <vector>
 #include <unordered_map>
 #include <functional>
 #include <mutex>
 #include <memory>
+#include <optional>
+#include <span>
+#include <tuple>
+#include <ranges>
+#include <algorithm>
+#include <type_traits>
+#include <typeinfo>
+#include <utility>
 
 
 template <typename T>
@@ -19,60 +35,119 @@ class EventManager {
 private:
 	static inline std::vector<std::shared_ptr<Subscription<T>>> subscriptions;
 	static inline std::vector<std::shared_ptr<Subscription<T>>> subscriptionsToAdd;
+	static inline std::vector<std::shared_ptr<Subscription<T>>> _subscriptionsToAdd; 	// Spare buffer swapped with 'subscriptionsToAdd', so neither loses its capacity.
 	static inline std::mutex subscriptionsToAddMutex;
 
-	static inline std::unordered_map<Key, std::vector<std::shared_ptr<Subscription<T>>>> keyedSubscriptionsMap;
-	static inline std::vector<std::pair<Key, std::shared_ptr<Subscription<T>>>> keyedSubscriptionsToAdd;
+	// Keyed subscriptions, indexed by KeyId; only touched by the thread managing events.
+	static inline std::vector<std::vector<std::shared_ptr<Subscription<T>>>> keyedSubscriptions;
+	static inline std::vector<std::pair<KeyId, std::shared_ptr<Subscription<T>>>> keyedSubscriptionsToAdd;
+	static inline std::vector<std::pair<KeyId, std::shared_ptr<Subscription<T>>>> _keyedSubscriptionsToAdd; 	// Spare buffer swapped with 'keyedSubscriptionsToAdd', so neither loses its capacity.
 	static inline std::mutex keyedSubscriptionsToAddMutex;
 
+	// Filtered subscriptions only get the events their filter matches; see subscribeFiltered().
+	static inline EventFilterIndex<T> filteredSubscriptionIndex;
+	static inline std::vector<std::pair<EventFilter<T>, std::shared_ptr<Subscription<T>>>> filteredSubscriptionsToAdd;
+	static inline std::vector<std::pair<EventFilter<T>, std::shared_ptr<Subscription<T>>>> _filteredSubscriptionsToAdd; 	// Spare buffer swapped with 'filteredSubscriptionsToAdd', so neither loses its capacity.
+	static inline std::mutex filteredSubscriptionsToAddMutex;
+
+	// Batch subscriptions get all events of a pass over the process requests, or of a phase run, at once.
+	static inline std::vector<std::shared_ptr<Subscription<std::span<const T>>>> batchSubscriptions;
+	static inline std::vector<std::shared_ptr<Subscription<std::span<const T>>>> batchSubscriptionsToAdd;
+	static inline std::vector<std::shared_ptr<Subscription<std::span<const T>>>> _batchSubscriptionsToAdd; 	// Spare buffer swapped with 'batchSubscriptionsToAdd', so neither loses its capacity.
+	static inline std::mutex batchSubscriptionsToAddMutex;
+
+	// Events collected for the batch subscriptions; only touched by the thread managing events.
+	static inline std::vector<T> batchedEvents;
+	static inline std::vector<T> _batchedEvents; 	// Spare buffer swapped with 'batchedEvents' when flushing.
+	static inline bool batchFlushRequested = false;
+
+	// Lease on the pooled event being dispatched on this thread; nullptr while dispatching an event that isn't pooled.
+	static inline thread_local const EventLease<T> * currentLease = nullptr;
+
+	// Set while this thread calls the subscriptions of this event type; see manageEventInline().
+	static inline thread_local bool dispatching = false;
+
 public:
 	static void manageEvent(T event) {
+		_manageEvent(event, nullptr);
+	}
+
+	// Manages the event right away from within another event type's dispatch (see EventPipeline). If this thread is calling the
+	// subscriptions of this event type already, a process is requested instead, so pipelines that loop back don't re-enter that.
+	static void manageEventInline(T event) {
+		if (dispatching) {
+			requestManagingProcessForEvent(event, _makeCancellationState());
+			return;
+		}
+		_manageEvent(event, nullptr);
+	}
+
+	// Like manageEvent() for each of the events, but only brings the subscription lists up to date once.
+	static void manageEvents(std::vector<T> & events) {
+		_registerEventType();
+
 		// Add subscriptions that are to be added.
 		_addToAddSubscriptions();
+		_addToAddFilteredSubscriptions();
+		_addToAddBatchSubscriptions();
 
 		// Remove subscriptions if they are invalid
 		_removeInvalidSubscriptions();
 
-		// Call subscriptions with events
-		for (auto & subscription : subscriptions) {
-			subscription->call(event);
+		for (T & event : events) {
+			_dispatchEvent(event);
 		}
 	}
 
-	static void manageKeyedEvent(Key key, T event) {
+	static void manageKeyedEvent(KeyId keyId, T event) {
+		_manageKeyedEvent(keyId, event, nullptr);
+	}
+
+	// Looks the key up now if it wasn't interned when published.
+	static void manageKeyedEvent(const PublishedKey & publishedKey, T event) {
+		std::optional<KeyId> keyId = publishedKey.find();
+		if (keyId) {
+			_manageKeyedEvent(*keyId, event, nullptr);
+		}
+	}
+
+	// Expects events with the same key next to each other (see addKeyedEvents()); looks up the subscriptions once per run of equal keys.
+	static void manageKeyedEvents(std::vector<std::pair<KeyId, T>> & keyedEvents) {
+		_registerEventType();
+
 		// Add subscriptions that are to be added.
 		_addToAddKeyedSubscriptions();
 
-		// Remove subscriptions if they are invalid
-		_removeInvalidKeyedSubscriptions();
-
 		// Call keyed subscriptions with events
-		try {
-			auto & subscriptionsForKey = keyedSubscriptionsMap.at(key);
-			for (auto & subscriptionForKey : subscriptionsForKey) {
-				subscriptionForKey->call(event);
+		const EventLease<T> * previousLease = std::exchange(currentLease, nullptr);
+		std::vector<std::shared_ptr<Subscription<T>>> * subscriptionsForKey = nullptr;
+		for (std::size_t i = 0; i < keyedEvents.size(); i++) {
+			auto & [keyId, event] = keyedEvents[i];
+			if (i == 0 || !(keyId == keyedEvents[i - 1].first)) {
+				subscriptionsForKey = (keyId.getIndex() < keyedSubscriptions.size()) ? &keyedSubscriptions[keyId.getIndex()] : nullptr;
+				if (subscriptionsForKey != nullptr) {
+					_removeInvalidSubscriptions(*subscriptionsForKey);
+				}
+			}
+			if (subscriptionsForKey == nullptr) {
+				continue;
+			}
+			for (auto & subscriptionForKey : *subscriptionsForKey) {
+				_deliverEvent(subscriptionForKey, event);
 			}
-		} catch(const std::out_of_range & oor) {
-			//nothing here.
 		}
+		currentLease = previousLease;
+	}
+
+	// For a handler that keeps the event it is called with beyond the call. Empty if that event isn't pooled (see addPooledEvent()).
+	static EventLease<T> leaseCurrentEvent() {
+		return (currentLease != nullptr) ? *currentLease : EventLease<T>();
 	}
 
 
 	template<typename Func, typename... Bindables>
 	static std::weak_ptr<Subscription<T>> subscribeRaw(Func func, Bindables... bindables){
-		// Bind the arguments to make a simple void(void) function call; doing this here because most uses of this function will force the use of bind anyway.
-		auto callbackFunction = std::bind(func, bindables..., std::placeholders::_1); 	// Leave a spot open with std::placeholders::_1 for the event type.
-
-		/// Add subscription to list of to-be-added subscriptions; return a SubscriptionHandle<> to the user.
-		subscriptionsToAddMutex.lock(); 	// Lock because all interactions with subscriptionsToAdd are mutex protected.
-		// Add subscription to list.
-		subscriptionsToAdd.emplace_back(std::make_shared<Subscription<T>>(callbackFunction));
-		// Get a reference to return.
-		std::shared_ptr<Subscription<T>> & subscriptionRef_sp = subscriptionsToAdd.back();
-		std::weak_ptr<Subscription<T>> subscription_wp(subscriptionRef_sp);
-		subscriptionsToAddMutex.unlock();
-
-		return subscription_wp;
+		return _subscribeRaw(EventLoop::currentInbox(), func, bindables...);
 	}
 
 	template<typename Func, typename... Bindables>
@@ -86,15 +161,71 @@ public:
 		return ret;
 	}
 
+	// Like subscribe(), but the subscriber is always called directly by whoever manages the event, also when subscribing from
+	// a thread with an EventLoop.
+	template<typename Func, typename... Bindables>
+	static SubscriptionHandle<T> subscribeInline(Func func, Bindables... bindables){
+		std::weak_ptr<Subscription<T>> subscription_wp = _subscribeRaw(std::weak_ptr<EventLoopInbox>(), func, bindables...);
+
+		SubscriptionHandle<T> ret(subscription_wp);
+
+		return ret;
+	}
+
+	// The subscriber only gets the events that match 'filter'; the filters of all such subscriptions are indexed together, so an
+	// event is matched against the subscriptions it comes close to rather than against each of them. Filtered subscriptions are
+	// called after the unfiltered ones, in no particular order among themselves.
+	template<typename Func, typename... Bindables>
+	static SubscriptionHandle<T> subscribeFiltered(const EventFilter<T> & filter, Func func, Bindables... bindables){
+		_registerEventType();
+
+		// Bind the arguments; leave a spot open with std::placeholders::_1 for the event type.
+		auto callbackFunction = std::bind(func, bindables..., std::placeholders::_1);
+		std::shared_ptr<Subscription<T>> filteredSubscription_sp = _makeSubscription(callbackFunction);
+
+		/// Add subscription to list of to-be-added subscriptions; return a SubscriptionHandle<> to the user.
+		filteredSubscriptionsToAddMutex.lock(); 	// Lock because all interactions with filteredSubscriptionsToAdd are mutex protected.
+		std::weak_ptr<Subscription<T>> filteredSubscription_wp(filteredSubscription_sp);
+		filteredSubscriptionsToAdd.emplace_back(filter, std::move(filteredSubscription_sp));
+		filteredSubscriptionsToAddMutex.unlock();
+
+		SubscriptionHandle<T> ret(filteredSubscription_wp);
+		return ret;
+	}
+
+	// The subscriber gets a std::span<const T> holding all events of a pass over the process requests (or of a phase run) in one call.
+	template<typename Func, typename... Bindables>
+	static BatchSubscriptionHandle<T> subscribeBatch(Func func, Bindables... bindables){
+		_registerEventType();
+
+		// Bind the arguments; leave a spot open with std::placeholders::_1 for the span of events.
+		auto callbackFunction = std::bind(func, bindables..., std::placeholders::_1);
+		std::shared_ptr<Subscription<std::span<const T>>> batchSubscription_sp = _makeSubscription<std::span<const T>>(callbackFunction);
+
+		/// Add subscription to list of to-be-added subscriptions; return a BatchSubscriptionHandle<> to the user.
+		batchSubscriptionsToAddMutex.lock(); 	// Lock because all interactions with batchSubscriptionsToAdd are mutex protected.
+		std::weak_ptr<Subscription<std::span<const T>>> batchSubscription_wp(batchSubscription_sp);
+		batchSubscriptionsToAdd.push_back(std::move(batchSubscription_sp));
+		batchSubscriptionsToAddMutex.unlock();
+
+		BatchSubscriptionHandle<T> ret(batchSubscription_wp);
+		return ret;
+	}
+
+	// 'keyInput' may be a KeyId from KeyRegistry::intern(), which skips interning the key again.
 	template<typename Func, typename KeyInputType, typename... Bindables>
 	static SubscriptionHandle<T> keyedSubscribe(Func func, KeyInputType keyInput, Bindables... bindables){
+		_registerEventType();
+
 		// Bind the arguments to make a simple void(void) function call; doing this here because most uses of this function will force the use of bind anyway.
 		auto callbackFunction = std::bind(func, bindables..., std::placeholders::_1); 	// Leave a spot open with std::placeholders::_1 for the event type.
+		std::shared_ptr<Subscription<T>> keyedSubscription_sp = _makeSubscription(callbackFunction);
+		KeyId keyId = KeyRegistry::intern(keyInput);
 
 		/// Add subscription to list of to-be-added subscriptions; return a SubscriptionHandle<> to the user.
 		keyedSubscriptionsToAddMutex.lock(); 	// Lock because all interactions with subscriptionsToAdd are mutex protected.
 		// Add subscription to list.
-		keyedSubscriptionsToAdd.emplace_back(Key(keyInput), std::make_shared<Subscription<T>>(callbackFunction));
+		keyedSubscriptionsToAdd.emplace_back(keyId, std::move(keyedSubscription_sp));
 		// Get a reference to create a SubscriptionHandle<>
 		std::shared_ptr<Subscription<T>> & keyedSubscriptionRef_sp = std::get<1>(keyedSubscriptionsToAdd.back()); 	//get the second item in the pair
 		// Create a SubscriptionHandle<> to return.
@@ -106,48 +237,487 @@ public:
 	}
 
 	template<typename... Arguments>
-	static void addEvent(Arguments... arguments) {
-		requestManagingProcessForEvent(T(arguments...));
+	static EventToken addEvent(Arguments... arguments) {
+		std::shared_ptr<EventCancellationState> cancellationState = _makeCancellationState();
+		requestManagingProcessForEvent(T(arguments...), cancellationState);
+		return EventToken(cancellationState);
 	}
 
 
+	// 'keyInput' may be a KeyId from KeyRegistry::intern(); publishers that keep one neither hash nor lock for the key.
+	// A key nobody subscribed to yet is looked up again once the event is managed; if still nobody did, only the unkeyed
+	// subscriptions get the event.
 	template<typename KeyInputType, typename... Arguments>
-	static void addKeyedEvent(KeyInputType keyInput, Arguments... arguments) {
-		requestManagingProcessForEvent(T(arguments...));
-		requestManagingProcessForKeyedEvent(Key(keyInput), T(arguments...));
+	static EventToken addKeyedEvent(KeyInputType keyInput, Arguments... arguments) {
+		std::shared_ptr<EventCancellationState> cancellationState = _makeCancellationState();
+		requestManagingProcessForEvent(T(arguments...), cancellationState);
+		requestManagingProcessForKeyedEvent(KeyRegistry::publish(keyInput), T(arguments...), cancellationState);
+		return EventToken(cancellationState);
+	}
+
+	// Like addEvent(), but the event comes out of EventPayloadPool<T> and goes back once the last subscriber, or lease, is done with it.
+	// Allocation free in steady state.
+	template<typename... Arguments>
+	static EventToken addPooledEvent(Arguments &&... arguments) {
+		EventLease<T> lease = EventPayloadPool<T>::acquire(std::forward<Arguments>(arguments)...);
+		std::shared_ptr<EventCancellationState> cancellationState = _makeCancellationState();
+		lease.pooledEvent->cancellationState = cancellationState;
+
+		// The request holds the lease as a raw pointer; that keeps it trivially copyable, so std::function stores it inline.
+		ProcessManager::requestProcess(_traced([pooledEvent = lease.release()]() {
+			EventLease<T> _lease = EventLease<T>::adopt(pooledEvent);
+			if (!pooledEvent->cancellationState->isCancelled()) {
+				EventManager<T>::_manageEvent(_lease.get(), &_lease);
+			}
+		}));
+		return EventToken(cancellationState);
+	}
+
+	// Like addKeyedEvent(), with the event out of EventPayloadPool<T>; unkeyed and keyed subscriptions share the one event.
+	// Only allocation free when 'keyInput' is a KeyId; any other key is turned into a Key to look it up, which may allocate.
+	template<typename KeyInputType, typename... Arguments>
+	static EventToken addPooledKeyedEvent(KeyInputType keyInput, Arguments &&... arguments) {
+		EventLease<T> lease = EventPayloadPool<T>::acquire(std::forward<Arguments>(arguments)...);
+		std::shared_ptr<EventCancellationState> cancellationState = _makeCancellationState();
+		lease.pooledEvent->cancellationState = cancellationState;
+
+		PublishedKey publishedKey = KeyRegistry::publish(keyInput);
+		if (std::optional<KeyId> keyId = publishedKey.getKeyId()) {
+			ProcessManager::requestProcess(_traced([pooledEvent = lease.release(), keyId = *keyId]() {
+				EventManager<T>::_managePooledKeyedEvent(pooledEvent, keyId);
+			}));
+		} else {
+			// Not interned yet; the request holds on to the key to look it up again, so it doesn't fit std::function inline.
+			ProcessManager::requestProcess(_traced([pooledEvent = lease.release(), publishedKey = std::move(publishedKey)]() {
+				EventManager<T>::_managePooledKeyedEvent(pooledEvent, publishedKey.find());
+			}));
+		}
+		return EventToken(cancellationState);
+	}
+
+	// Publishes a burst of keyed events; each element holds a key input and either a single constructor argument for T or a tuple of them.
+	// The events are grouped by key, so each key's subscriptions are looked up once and called for its events in publish order.
+	// Unkeyed subscriptions get all events, in publish order, before any keyed subscription is called. Keys nobody subscribed
+	// to yet are looked up again once the burst is managed; events for keys still nobody subscribed to only go to the unkeyed
+	// subscriptions.
+	template<std::ranges::input_range KeyedArgumentsRange>
+	static EventToken addKeyedEvents(const KeyedArgumentsRange & keyedArgumentsRange) {
+		std::vector<T> events;
+		std::vector<PublishedKey> publishedKeys;
+		if constexpr (std::ranges::sized_range<KeyedArgumentsRange>) {
+			events.reserve(std::ranges::size(keyedArgumentsRange));
+			publishedKeys.reserve(std::ranges::size(keyedArgumentsRange));
+		}
+
+		bool allInterned = true;
+		for (const auto & keyedArguments : keyedArgumentsRange) {
+			publishedKeys.push_back(KeyRegistry::publish(std::get<0>(keyedArguments)));
+			allInterned = allInterned && publishedKeys.back().getKeyId();
+			events.push_back(_makeEvent(std::get<1>(keyedArguments)));
+		}
+
+		// One token for the whole burst.
+		std::shared_ptr<EventCancellationState> cancellationState = _makeCancellationState();
+		if (allInterned) {
+			// Group them here rather than on the thread managing them.
+			std::vector<std::pair<KeyId, T>> keyedEvents = _groupByKey(publishedKeys, events, &PublishedKey::getKeyId);
+			ProcessManager::requestProcess(_traced([events = std::move(events), cancellationState]() mutable {
+				if (!cancellationState->isCancelled()) {
+					EventManager<T>::manageEvents(events);
+				}
+			}));
+			ProcessManager::requestProcess(_traced([keyedEvents = std::move(keyedEvents), cancellationState]() mutable {
+				if (!cancellationState->isCancelled()) {
+					EventManager<T>::manageKeyedEvents(keyedEvents);
+				}
+			}));
+		} else {
+			ProcessManager::requestProcess(_traced([events = std::move(events), publishedKeys = std::move(publishedKeys), cancellationState]() mutable {
+				if (!cancellationState->isCancelled()) {
+					std::vector<std::pair<KeyId, T>> keyedEvents = _groupByKey(publishedKeys, events, &PublishedKey::find);
+					EventManager<T>::manageEvents(events);
+					EventManager<T>::manageKeyedEvents(keyedEvents);
+				}
+			}));
+		}
+		return EventToken(cancellationState);
 	}
 
 	template<typename... Arguments>
-	static void addPhasedEvent(PhaseID phaseID, unsigned int offset, Arguments... arguments) {
+	static EventToken addPhasedEvent(PhaseID phaseID, unsigned int offset, Arguments... arguments) {
 		//offset: 0 -> NOW
 		//offset: 1 -> NEXT RUN
 		// etc.
-		std::function<void(void)> eventManagementFunction = std::bind(&EventManager<T>::manageEvent, T(arguments...));
-		PhaseManager::registerEventCallback(phaseID, offset, eventManagementFunction);
+		std::shared_ptr<EventCancellationState> cancellationState = _makeCancellationState();
+		PhaseManager::registerEventCall(phaseID, offset, _traced([event = T(arguments...)]() mutable {
+			EventManager<T>::manageEvent(std::move(event));
+		}), cancellationState);
+		return EventToken(cancellationState);
 	}
 
 	template<typename KeyInputType, typename... Arguments>
-	static void addPhasedKeyedEvent(PhaseID phaseID, KeyInputType keyInput, unsigned int offset, Arguments... arguments) {
+	static EventToken addPhasedKeyedEvent(PhaseID phaseID, KeyInputType keyInput, unsigned int offset, Arguments... arguments) {
 		//offset: 0 -> NOW
 		//offset: 1 -> NEXT RUN
 		// etc.
-		addPhasedEvent(phaseID, offset, arguments...);
-		std::function<void(void)> eventManagementFunction = std::bind(&EventManager<T>::manageKeyedEvent, Key(keyInput), T(arguments...));
-		PhaseManager::registerEventCallback(phaseID, offset, eventManagementFunction);
+		// One call for both the unkeyed and the keyed subscriptions, so a single token can take it out of the phase.
+		std::shared_ptr<EventCancellationState> cancellationState = _makeCancellationState();
+		PhaseManager::registerEventCall(phaseID, offset, _traced([publishedKey = KeyRegistry::publish(keyInput), event = T(arguments...)]() mutable {
+			EventManager<T>::manageEvent(event);
+			EventManager<T>::manageKeyedEvent(publishedKey, std::move(event));
+		}), cancellationState);
+		return EventToken(cancellationState);
+	}
+
+	// Estimate of the bytes held by the subscription lists of this event type. Call from the thread running ProcessManager.
+	// The subscriptions themselves live in ObjectPool<> slabs; see EventTypeRegistry::getPooledMemoryFootprint().
+	static std::size_t getMemoryFootprint() {
+		std::size_t footprint = 0;
+
+		footprint += subscriptions.capacity() * sizeof(std::shared_ptr<Subscription<T>>);
+
+		footprint += keyedSubscriptions.capacity() * sizeof(std::vector<std::shared_ptr<Subscription<T>>>);
+		for (auto & subscriptionsForKey : keyedSubscriptions) {
+			footprint += subscriptionsForKey.capacity() * sizeof(std::shared_ptr<Subscription<T>>);
+		}
+
+		subscriptionsToAddMutex.lock();
+		footprint += subscriptionsToAdd.capacity() * sizeof(std::shared_ptr<Subscription<T>>);
+		subscriptionsToAddMutex.unlock();
+
+		keyedSubscriptionsToAddMutex.lock();
+		footprint += keyedSubscriptionsToAdd.capacity() * sizeof(std::pair<KeyId, std::shared_ptr<Subscription<T>>>);
+		keyedSubscriptionsToAddMutex.unlock();
+
+		batchSubscriptionsToAddMutex.lock();
+		footprint += batchSubscriptionsToAdd.capacity() * sizeof(std::shared_ptr<Subscription<std::span<const T>>>);
+		batchSubscriptionsToAddMutex.unlock();
+
+		footprint += batchSubscriptions.capacity() * sizeof(std::shared_ptr<Subscription<std::span<const T>>>);
+		footprint += (batchedEvents.capacity() + _batchedEvents.capacity()) * sizeof(T);
+
+		footprint += _subscriptionsToAdd.capacity() * sizeof(std::shared_ptr<Subscription<T>>);
+		footprint += _batchSubscriptionsToAdd.capacity() * sizeof(std::shared_ptr<Subscription<std::span<const T>>>);
+		footprint += _keyedSubscriptionsToAdd.capacity() * sizeof(std::pair<KeyId, std::shared_ptr<Subscription<T>>>);
+
+		footprint += filteredSubscriptionIndex.getMemoryFootprint();
+		filteredSubscriptionsToAddMutex.lock();
+		footprint += filteredSubscriptionsToAdd.capacity() * sizeof(std::pair<EventFilter<T>, std::shared_ptr<Subscription<T>>>);
+		filteredSubscriptionsToAddMutex.unlock();
+		footprint += _filteredSubscriptionsToAdd.capacity() * sizeof(std::pair<EventFilter<T>, std::shared_ptr<Subscription<T>>>);
+
+		footprint += EventPayloadPool<T>::getMemoryFootprint();
+
+		return footprint;
+	}
+
+	// Drop invalid subscriptions and give back memory left over from earlier peaks. Call from the thread running ProcessManager.
+	static void compact() {
+		_addToAddSubscriptions();
+		_removeInvalidSubscriptions();
+		subscriptions.shrink_to_fit();
+
+		_addToAddKeyedSubscriptions();
+		_removeInvalidKeyedSubscriptions();
+		for (auto & subscriptionsForKey : keyedSubscriptions) {
+			subscriptionsForKey.shrink_to_fit();
+		}
+		// Trailing keys without subscriptions needn't have a slot; a later subscription grows the table again.
+		while (!keyedSubscriptions.empty() && keyedSubscriptions.back().empty()) {
+			keyedSubscriptions.pop_back();
+		}
+		keyedSubscriptions.shrink_to_fit();
+
+		subscriptionsToAddMutex.lock();
+		subscriptionsToAdd.shrink_to_fit();
+		subscriptionsToAddMutex.unlock();
+		_subscriptionsToAdd.shrink_to_fit();
+
+		keyedSubscriptionsToAddMutex.lock();
+		keyedSubscriptionsToAdd.shrink_to_fit();
+		keyedSubscriptionsToAddMutex.unlock();
+		_keyedSubscriptionsToAdd.shrink_to_fit();
+
+		_addToAddFilteredSubscriptions();
+		filteredSubscriptionIndex.compact();
+		filteredSubscriptionsToAddMutex.lock();
+		filteredSubscriptionsToAdd.shrink_to_fit();
+		filteredSubscriptionsToAddMutex.unlock();
+		_filteredSubscriptionsToAdd.shrink_to_fit();
+
+		_addToAddBatchSubscriptions();
+		_removeInvalidBatchSubscriptions();
+		batchSubscriptions.shrink_to_fit();
+		batchSubscriptionsToAddMutex.lock();
+		batchSubscriptionsToAdd.shrink_to_fit();
+		batchSubscriptionsToAddMutex.unlock();
+		_batchSubscriptionsToAdd.shrink_to_fit();
+		if (batchedEvents.empty()) {
+			batchedEvents.shrink_to_fit();
+		}
+		_batchedEvents.shrink_to_fit();
+
+		EventPayloadPool<T>::compact();
 	}
 
 private:
-	static void requestManagingProcessForEvent(const T & event) {
-		ProcessManager::requestProcess(&EventManager<T>::manageEvent, event);
+	static void _registerEventType() {
+		// Registers once; the static is only initialized on the first call.
+		static const bool registered = (EventTypeRegistry::registerEventType(typeid(T), &EventManager<T>::getMemoryFootprint, &EventManager<T>::compact), true);
+		(void)registered;
+	}
+
+	static void _manageEvent(T & event, const EventLease<T> * lease) {
+		_registerEventType();
+
+		// Add subscriptions that are to be added.
+		_addToAddSubscriptions();
+		_addToAddFilteredSubscriptions();
+		_addToAddBatchSubscriptions();
+
+		// Remove subscriptions if they are invalid
+		_removeInvalidSubscriptions();
+
+		_dispatchEvent(event, lease);
+	}
+
+	static void _manageKeyedEvent(KeyId keyId, T & event, const EventLease<T> * lease) {
+		_registerEventType();
+
+		// Add subscriptions that are to be added.
+		_addToAddKeyedSubscriptions();
+
+		// Call keyed subscriptions with events
+		if (keyId.getIndex() >= keyedSubscriptions.size()) {
+			return;
+		}
+		auto & subscriptionsForKey = keyedSubscriptions[keyId.getIndex()];
+		// Remove subscriptions if they are invalid; only this key's, the others are swept when they get an event or on compact().
+		_removeInvalidSubscriptions(subscriptionsForKey);
+		const EventLease<T> * previousLease = std::exchange(currentLease, lease);
+		for (auto & subscriptionForKey : subscriptionsForKey) {
+			_deliverEvent(subscriptionForKey, event);
+		}
+		currentLease = previousLease;
+	}
+
+	static void requestManagingProcessForEvent(const T & event, const std::shared_ptr<EventCancellationState> & cancellationState) {
+		ProcessManager::requestProcess(_traced([event, cancellationState]() mutable {
+			if (!cancellationState->isCancelled()) {
+				EventManager<T>::manageEvent(std::move(event));
+			}
+		}));
+	}
+
+	static void requestManagingProcessForKeyedEvent(PublishedKey publishedKey, const T & event, const std::shared_ptr<EventCancellationState> & cancellationState) {
+		ProcessManager::requestProcess(_traced([publishedKey = std::move(publishedKey), event, cancellationState]() mutable {
+			if (!cancellationState->isCancelled()) {
+				EventManager<T>::manageKeyedEvent(publishedKey, std::move(event));
+			}
+		}));
+	}
+
+	static void _managePooledKeyedEvent(PooledEvent<T> * pooledEvent, std::optional<KeyId> keyId) {
+		EventLease<T> _lease = EventLease<T>::adopt(pooledEvent);
+		if (!pooledEvent->cancellationState->isCancelled()) {
+			EventManager<T>::_manageEvent(_lease.get(), &_lease);
+			if (keyId) {
+				EventManager<T>::_manageKeyedEvent(*keyId, _lease.get(), &_lease);
+			}
+		}
+	}
+
+	// Pairs each event with its key's id, grouped by key id; stable so events for the same key keep their order. Events
+	// whose key 'getKeyId' finds no id for are left out.
+	static std::vector<std::pair<KeyId, T>> _groupByKey(const std::vector<PublishedKey> & publishedKeys, const std::vector<T> & events, std::optional<KeyId> (PublishedKey::*getKeyId)() const) {
+		std::vector<std::optional<KeyId>> keyIds;
+		keyIds.reserve(publishedKeys.size());
+		for (const PublishedKey & publishedKey : publishedKeys) {
+			keyIds.push_back((publishedKey.*getKeyId)());
+		}
+
+		// Sort indices, T needn't be assignable.
+		std::vector<std::size_t> order;
+		order.reserve(events.size());
+		for (std::size_t i = 0; i < events.size(); i++) {
+			if (keyIds[i]) {
+				order.push_back(i);
+			}
+		}
+		std::stable_sort(
+			order.begin(),
+			order.end(),
+			[&keyIds](std::size_t lhs, std::size_t rhs) {
+				return keyIds[lhs]->getIndex() < keyIds[rhs]->getIndex();
+			}
+		);
+
+		std::vector<std::pair<KeyId, T>> keyedEvents;
+		keyedEvents.reserve(order.size());
+		for (std::size_t i : order) {
+			keyedEvents.emplace_back(*keyIds[i], events[i]);
+		}
+		return keyedEvents;
+	}
+
+	static std::shared_ptr<EventCancellationState> _makeCancellationState() {
+		// Out of a pool, like subscriptions; publishing stays allocation free in steady state.
+		return std::allocate_shared<EventCancellationState>(PoolAllocator<EventCancellationState>());
+	}
+
+	// Wraps the dispatch of a published event so its wait and dispatch show up in the trace; hands the dispatch back untouched without tracing.
+	template<typename Callable>
+	static auto _traced(Callable && dispatch) {
+#ifdef EVENTHANDLING_TRACING
+		return [flowID = EventTracer::publish(typeid(T).name()), dispatch = std::forward<Callable>(dispatch)]() mutable {
+			EventTracer::DispatchScope dispatchScope(typeid(T).name(), flowID);
+			dispatch();
+		};
+#else
+		return std::forward<Callable>(dispatch);
+#endif
+	}
+
+	static void _deliverEvent(std::shared_ptr<Subscription<T>> & subscription, T & event) {
+		if (!subscription->isOnEventLoop()) {
+			subscription->call(event);
+		} else if (currentLease != nullptr) {
+			// Pooled; the subscriber's loop shares the event through a lease instead of a copy.
+			EventLoop::postTo(subscription->getEventLoopInbox(), [subscription, lease = *currentLease]() {
+				const EventLease<T> * previousLease = std::exchange(currentLease, &lease);
+				subscription->call(lease.get());
+				currentLease = previousLease;
+			});
+		} else {
+			// Let the subscriber's own loop call it; the copy of the event travels along.
+			EventLoop::postTo(subscription->getEventLoopInbox(), &Subscription<T>::call, subscription, event);
+		}
+	}
+
+	template<typename SubscriptionEventType = T, typename Callable>
+	static std::shared_ptr<Subscription<SubscriptionEventType>> _makeSubscription(Callable callbackFunction, std::weak_ptr<EventLoopInbox> eventLoopInbox = EventLoop::currentInbox()) {
+		// Subscription, callback and reference counts share one block out of the pool for this subscription type.
+		return std::allocate_shared<BoundSubscription<SubscriptionEventType, Callable>>(PoolAllocator<BoundSubscription<SubscriptionEventType, Callable>>(), callbackFunction, std::move(eventLoopInbox));
+	}
+
+	template<typename Func, typename... Bindables>
+	static std::weak_ptr<Subscription<T>> _subscribeRaw(std::weak_ptr<EventLoopInbox> eventLoopInbox, Func func, Bindables... bindables){
+		_registerEventType();
+
+		// Bind the arguments to make a simple void(void) function call; doing this here because most uses of this function will force the use of bind anyway.
+		auto callbackFunction = std::bind(func, bindables..., std::placeholders::_1); 	// Leave a spot open with std::placeholders::_1 for the event type.
+		std::shared_ptr<Subscription<T>> subscription_sp = _makeSubscription(callbackFunction, std::move(eventLoopInbox));
+
+		/// Add subscription to list of to-be-added subscriptions; return a SubscriptionHandle<> to the user.
+		subscriptionsToAddMutex.lock(); 	// Lock because all interactions with subscriptionsToAdd are mutex protected.
+		// Add subscription to list.
+		subscriptionsToAdd.push_back(std::move(subscription_sp));
+		// Get a reference to return.
+		std::shared_ptr<Subscription<T>> & subscriptionRef_sp = subscriptionsToAdd.back();
+		std::weak_ptr<Subscription<T>> subscription_wp(subscriptionRef_sp);
+		subscriptionsToAddMutex.unlock();
+
+		return subscription_wp;
+	}
+
+	static void _dispatchEvent(T & event, const EventLease<T> * lease = nullptr) {
+		const EventLease<T> * previousLease = std::exchange(currentLease, lease);
+		bool wasDispatching = std::exchange(dispatching, true);
+
+		// Call subscriptions with events
+		for (auto & subscription : subscriptions) {
+			_deliverEvent(subscription, event);
+		}
+		filteredSubscriptionIndex.forEachMatch(event, [&event](std::shared_ptr<Subscription<T>> & filteredSubscription) {
+			_deliverEvent(filteredSubscription, event);
+		});
+		dispatching = wasDispatching;
+
+		// Keep the event for the batch subscriptions; a pooled event stays with its leases, the batch gets a copy.
+		if (!batchSubscriptions.empty()) {
+			_batchEvent((lease != nullptr) ? T(event) : std::move(event));
+		}
+
+		currentLease = previousLease;
+	}
+
+	template<typename EventArguments>
+	static T _makeEvent(const EventArguments & eventArguments) {
+		if constexpr (std::is_constructible_v<T, const EventArguments &>) {
+			return T(eventArguments);
+		} else {
+			return std::make_from_tuple<T>(eventArguments);
+		}
+	}
+
+	static void _batchEvent(T && event) {
+		batchedEvents.push_back(std::move(event));
+		if (batchFlushRequested) {
+			return;
+		}
+
+		// Hand the batch over once the current phase run or pass is done; outside of those there's nothing to batch with. Not at
+		// the end of the drain: that never comes while events keep coming in, and the batch would only grow.
+		if (Phase::isRunningPhase()) {
+			batchFlushRequested = true;
+			Phase::requestAtRunEnd(&EventManager<T>::_flushBatchedEvents);
+		} else if (ProcessManager::isHandlingProcessRequests()) {
+			batchFlushRequested = true;
+			ProcessManager::requestProcessAtPassEnd(&EventManager<T>::_flushBatchedEvents);
+		} else {
+			_flushBatchedEvents();
+		}
+	}
+
+	static void _flushBatchedEvents() {
+		batchFlushRequested = false;
+
+		_addToAddBatchSubscriptions();
+		_removeInvalidBatchSubscriptions();
+
+		// Swap so events managed by the batch subscribers start a new batch.
+		std::swap(batchedEvents, _batchedEvents);
+		std::span<const T> events(_batchedEvents);
+		bool wasDispatching = std::exchange(dispatching, true);
+		for (auto & batchSubscription : batchSubscriptions) {
+			if (!batchSubscription->isOnEventLoop()) {
+				batchSubscription->call(events);
+			} else {
+				// The batch buffer is reused; the subscriber's loop gets its own copy of the events.
+				EventLoop::postTo(batchSubscription->getEventLoopInbox(), [batchSubscription, eventsCopy = std::vector<T>(events.begin(), events.end())]() {
+					std::span<const T> _events(eventsCopy);
+					batchSubscription->call(_events);
+				});
+			}
+		}
+		dispatching = wasDispatching;
+		_batchedEvents.clear();
 	}
 
-	static void requestManagingProcessForKeyedEvent(const Key & key, const T & event) {
-		ProcessManager::requestProcess(&EventManager<T>::manageKeyedEvent, key, event);
+	static void _addToAddBatchSubscriptions() {
+		batchSubscriptionsToAddMutex.lock();
+		std::swap(batchSubscriptionsToAdd, _batchSubscriptionsToAdd);
+		batchSubscriptionsToAddMutex.unlock();
+
+		std::move(_batchSubscriptionsToAdd.begin(), _batchSubscriptionsToAdd.end(), std::back_inserter(batchSubscriptions));
+		_batchSubscriptionsToAdd.clear();
+	}
+
+	static void _removeInvalidBatchSubscriptions() {
+		batchSubscriptions.erase(
+			std::remove_if(
+				batchSubscriptions.begin(),
+				batchSubscriptions.end(),
+				[](std::shared_ptr<Subscription<std::span<const T>>> & batchSubscription) {
+					return !batchSubscription->isValid();
+				}
+			),
+			batchSubscriptions.end()
+		);
 	}
 
 	static void _addToAddSubscriptions() {
-		// Swap out 'subscriptionsToAdd' list for an empty copy; this feels more neat and faster.
-		std::vector<std::shared_ptr<Subscription<T>>> _subscriptionsToAdd;
+		// Swap out 'subscriptionsToAdd' list for the (empty) spare one; this feels more neat and faster.
 		subscriptionsToAddMutex.lock();
 		std::swap(subscriptionsToAdd, _subscriptionsToAdd);
 		subscriptionsToAddMutex.unlock();
@@ -155,64 +725,64 @@ private:
 		// Insert the to-be-added subscriptions to the subscriptions list.
 		subscriptions.reserve(subscriptions.size() + _subscriptionsToAdd.size());
 		std::move(_subscriptionsToAdd.begin(), _subscriptionsToAdd.end(), std::back_inserter(subscriptions));
+		_subscriptionsToAdd.clear();
+	}
+
+	static void _addToAddFilteredSubscriptions() {
+		filteredSubscriptionsToAddMutex.lock();
+		std::swap(filteredSubscriptionsToAdd, _filteredSubscriptionsToAdd);
+		filteredSubscriptionsToAddMutex.unlock();
+
+		for (auto & [filter, filteredSubscription] : _filteredSubscriptionsToAdd) {
+			filteredSubscriptionIndex.add(filter, std::move(filteredSubscription));
+		}
+		_filteredSubscriptionsToAdd.clear();
 	}
 
 	static void _addToAddKeyedSubscriptions() {
-		// Swap out 'keyedSubscriptionsToAdd' list for an empty copy; this feels more neat and faster.
-		std::vector<std::pair<Key, std::shared_ptr<Subscription<T>>>> _keyedSubscriptionsToAdd;
+		// Swap out 'keyedSubscriptionsToAdd' list for the (empty) spare one; this feels more neat and faster.
 		keyedSubscriptionsToAddMutex.lock();
 		std::swap(keyedSubscriptionsToAdd, _keyedSubscriptionsToAdd);
 		keyedSubscriptionsToAddMutex.unlock();
 
 		// Insert the to-be-added subscriptions to the subscriptions list.
-		for (std::pair<Key, std::shared_ptr<Subscription<T>>> & _keyedSubscriptionToAdd : _keyedSubscriptionsToAdd) {
-			// Get key.
-			const Key & keyRef = std::get<0>(_keyedSubscriptionToAdd);
+		for (std::pair<KeyId, std::shared_ptr<Subscription<T>>> & _keyedSubscriptionToAdd : _keyedSubscriptionsToAdd) {
+			// Get key id.
+			std::uint32_t keyIndex = std::get<0>(_keyedSubscriptionToAdd).getIndex();
+			if (keyIndex >= keyedSubscriptions.size()) {
+				keyedSubscriptions.resize(keyIndex + 1);
+			}
 			// Get a reference to the vector we're adding the subscription to.
-			auto & subscriptionVectorToAddTo = keyedSubscriptionsMap[keyRef];
+			auto & subscriptionVectorToAddTo = keyedSubscriptions[keyIndex];
 
 			// Create a dummy element.
 			subscriptionVectorToAddTo.push_back(std::shared_ptr<Subscription<T>>());
 			// Switch the dummy element with the real thing.
 			std::swap(std::get<1>(_keyedSubscriptionToAdd), subscriptionVectorToAddTo.back());
 		}
+		_keyedSubscriptionsToAdd.clear();
 	}
 
 	static void _removeInvalidSubscriptions() {
-		subscriptions.erase(
+		_removeInvalidSubscriptions(subscriptions);
+	}
+
+	static void _removeInvalidSubscriptions(std::vector<std::shared_ptr<Subscription<T>>> & subscriptionList) {
+		subscriptionList.erase(
 			std::remove_if(
-				subscriptions.begin(),
-				subscriptions.end(),
+				subscriptionList.begin(),
+				subscriptionList.end(),
 				[](std::shared_ptr<Subscription<T>> & subscription) {
 					return !subscription->isValid();
 				}
 			),
-			subscriptions.end()
+			subscriptionList.end()
 		);
 	}
 
 	static void _removeInvalidKeyedSubscriptions() {
-		std::vector<Key> keysToBeRemoved;
-
-		for (auto & [key, subscriptionsForKey] : keyedSubscriptionsMap) {
-			subscriptionsForKey.erase(
-				std::remove_if(
-					subscriptionsForKey.begin(),
-					subscriptionsForKey.end(),
-					[](std::shared_ptr<Subscription<T>> & subscription) {
-						return !subscription->isValid();
-					}
-				),
-				subscriptionsForKey.end()
-			);
-
-			if (subscriptionsForKey.empty()) {
-				keysToBeRemoved.push_back(key);
-			}
-		}
-
-		for (const Key & keyToBeRemoved : keysToBeRemoved) {
-			keyedSubscriptionsMap.erase(keyToBeRemoved);
+		for (auto & subscriptionsForKey : keyedSubscriptions) {
+			_removeInvalidSubscriptions(subscriptionsForKey);
 		}
 	}
 };
@@ -0,0 +1,174 @@
+#pragma once
+
+#include "EventToken.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+
+template <typename T>
+class EventManager;
+
+template <typename T>
+class EventPayloadPool;
+
+
+// An event out of EventPayloadPool<T>, with the reference count of the leases on it.
+template <typename T>
+struct PooledEvent {
+	std::optional<T> event; 	// Stays constructed while in the pool, so its buffers survive for the next publish.
+	std::atomic<std::uint32_t> references{0};
+	std::shared_ptr<EventCancellationState> cancellationState; 	// Of the publish currently using the event.
+	PooledEvent * next = nullptr;
+};
+
+
+// Reference counted handle on a pooled event; the event goes back to the pool when the last lease is dropped.
+template <typename T>
+class EventLease {
+	template <typename> friend class EventManager;
+	friend class EventPayloadPool<T>;
+
+private:
+	PooledEvent<T> * pooledEvent;
+
+	explicit EventLease(PooledEvent<T> * pooledEvent) :
+			pooledEvent(pooledEvent)
+	{
+	}
+
+public:
+	EventLease() :
+			pooledEvent(nullptr)
+	{
+	}
+
+	EventLease(const EventLease & other) :
+			pooledEvent(other.pooledEvent)
+	{
+		if (pooledEvent != nullptr) {
+			pooledEvent->references.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	EventLease(EventLease && other) noexcept :
+			pooledEvent(std::exchange(other.pooledEvent, nullptr))
+	{
+	}
+
+	EventLease & operator=(EventLease other) noexcept {
+		std::swap(pooledEvent, other.pooledEvent);
+		return *this;
+	}
+
+	~EventLease() {
+		reset();
+	}
+
+	void reset() {
+		if (pooledEvent != nullptr && pooledEvent->references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+			EventPayloadPool<T>::recycle(pooledEvent);
+		}
+		pooledEvent = nullptr;
+	}
+
+	explicit operator bool() const {
+		return pooledEvent != nullptr;
+	}
+
+	T & get() const {
+		return *pooledEvent->event;
+	}
+
+	T & operator*() const {
+		return get();
+	}
+
+	T * operator->() const {
+		return &get();
+	}
+
+private:
+	// Hands the reference over to a raw pointer, e.g. to keep a process request trivially copyable; take it back with adopt().
+	PooledEvent<T> * release() {
+		return std::exchange(pooledEvent, nullptr);
+	}
+
+	static EventLease adopt(PooledEvent<T> * pooledEvent) {
+		return EventLease(pooledEvent);
+	}
+};
+
+
+// Recycles events of type T, including whatever buffers they own. A recycled event is refilled through
+// T::assign(arguments...) when T has one (keeping e.g. a string's capacity), otherwise it is constructed anew in place.
+// Events are only given back by compact().
+template <typename T>
+class EventPayloadPool {
+private:
+	static inline PooledEvent<T> * freeList = nullptr;
+	static inline std::size_t eventCount = 0;
+	static inline std::size_t freeEventCount = 0;
+	static inline std::mutex freeListMutex;
+
+public:
+	template<typename... Arguments>
+	static EventLease<T> acquire(Arguments &&... arguments) {
+		freeListMutex.lock(); 	// Events come back from whichever thread drops the last lease; so mutex it.
+		PooledEvent<T> * pooledEvent = freeList;
+		if (pooledEvent != nullptr) {
+			freeList = pooledEvent->next;
+			freeEventCount--;
+		} else {
+			eventCount++;
+		}
+		freeListMutex.unlock();
+
+		if (pooledEvent == nullptr) {
+			pooledEvent = new PooledEvent<T>();
+			pooledEvent->event.emplace(std::forward<Arguments>(arguments)...);
+		} else if constexpr (requires (T & event, Arguments &&... _arguments) { event.assign(std::forward<Arguments>(_arguments)...); }) {
+			pooledEvent->event->assign(std::forward<Arguments>(arguments)...);
+		} else {
+			pooledEvent->event.emplace(std::forward<Arguments>(arguments)...);
+		}
+		pooledEvent->references.store(1, std::memory_order_relaxed);
+
+		return EventLease<T>(pooledEvent);
+	}
+
+	static void recycle(PooledEvent<T> * pooledEvent) {
+		pooledEvent->cancellationState.reset();
+
+		freeListMutex.lock();
+		pooledEvent->next = freeList;
+		freeList = pooledEvent;
+		freeEventCount++;
+		freeListMutex.unlock();
+	}
+
+	// Bytes held by the pooled events themselves; buffers owned by the events aren't counted.
+	static std::size_t getMemoryFootprint() {
+		freeListMutex.lock();
+		std::size_t footprint = eventCount * sizeof(PooledEvent<T>);
+		freeListMutex.unlock();
+		return footprint;
+	}
+
+	// Deletes the events that are back in the pool.
+	static void compact() {
+		freeListMutex.lock();
+		PooledEvent<T> * _freeList = std::exchange(freeList, nullptr);
+		eventCount -= freeEventCount;
+		freeEventCount = 0;
+		freeListMutex.unlock();
+
+		while (_freeList != nullptr) {
+			delete std::exchange(_freeList, _freeList->next);
+		}
+	}
+};
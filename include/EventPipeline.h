@@ -0,0 +1,77 @@
+#pragma once
+
+#include "EventManager.h"
+#include "SubscriptionHandle.h"
+
+#include <type_traits>
+#include <utility>
+
+
+// Stages of a pipeline without any: the source event is passed on as is.
+struct EventPipelineSource {
+	template<typename Event, typename Sink>
+	void operator()(Event & event, Sink && sink) const {
+		sink(event);
+	}
+};
+
+
+// A -> filter -> map -> B, declared up front and run inline in A's dispatch; no process request or phase queue entry per stage.
+//
+//	SubscriptionHandle<A> handle = EventPipeline<A>().filter(predicate).map(transform).to<B>();
+//
+// B's subscribers are called right away from A's dispatch, as by EventManager<B>::manageEvent(); otherwise they keep their usual
+// semantics (event loops, batches, compaction). The stages run on the thread managing A, also when the pipeline is built on a
+// thread with an EventLoop. The pipeline stays in place for as long as the returned handle.
+template <typename Source, typename Current = Source, typename Stages = EventPipelineSource>
+class EventPipeline {
+	template <typename, typename, typename> friend class EventPipeline;
+
+private:
+	Stages stages; 	// Called with the source event and a sink; calls the sink with each Current that makes it through.
+
+	explicit EventPipeline(Stages stages) :
+			stages(std::move(stages))
+	{
+	}
+
+public:
+	EventPipeline() = default;
+
+	// Passes on the events for which 'predicate(const Current &)' holds.
+	template<typename Predicate>
+	auto filter(Predicate predicate) const {
+		auto _stages = [stages = stages, predicate = std::move(predicate)](Source & event, auto && sink) {
+			stages(event, [&predicate, &sink](auto && current) {
+				if (predicate(std::as_const(current))) {
+					sink(std::forward<decltype(current)>(current));
+				}
+			});
+		};
+		return EventPipeline<Source, Current, decltype(_stages)>(std::move(_stages));
+	}
+
+	// Passes on 'transform(const Current &)' instead of the event.
+	template<typename Transform>
+	auto map(Transform transform) const {
+		typedef std::decay_t<std::invoke_result_t<const Transform &, const Current &>> Next;
+
+		auto _stages = [stages = stages, transform = std::move(transform)](Source & event, auto && sink) {
+			stages(event, [&transform, &sink](auto && current) {
+				sink(Next(transform(std::as_const(current))));
+			});
+		};
+		return EventPipeline<Source, Next, decltype(_stages)>(std::move(_stages));
+	}
+
+	// Ends the pipeline in EventManager<Destination>, which gets a Destination constructed from what the last stage passes on.
+	// The source event itself is copied; whatever a map() stage produced is moved.
+	template<typename Destination>
+	SubscriptionHandle<Source> to() const {
+		return EventManager<Source>::subscribeInline([stages = stages](Source & event) {
+			stages(event, [](auto && current) {
+				EventManager<Destination>::manageEventInline(Destination(std::forward<decltype(current)>(current)));
+			});
+		});
+	}
+};
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+class Phase;
+class PhaseEventNode;
+
+// Shared between an EventToken and the event it was handed out for.
+class EventCancellationState {
+private:
+	std::atomic<bool> cancelled;
+
+	// Set while the event waits in a phase; both guarded by that phase's lock.
+	Phase * phase;
+	PhaseEventNode * phaseEventNode;
+
+public:
+	EventCancellationState() :
+			cancelled(false),
+			phase(nullptr),
+			phaseEventNode(nullptr)
+	{
+	}
+
+	bool isCancelled() const {
+		return cancelled.load(std::memory_order_acquire);
+	}
+
+	void cancel(); 	//defined in Phase.h
+
+	void attachPhaseEventNode(Phase * phase, PhaseEventNode * phaseEventNode) {
+		this->phase = phase;
+		this->phaseEventNode = phaseEventNode;
+	}
+
+	// The event moved to another node of the same phase.
+	void movePhaseEventNode(PhaseEventNode * phaseEventNode) {
+		this->phaseEventNode = phaseEventNode;
+	}
+
+	void detachPhaseEventNode() {
+		phaseEventNode = nullptr;
+	}
+
+	PhaseEventNode * getPhaseEventNode() const {
+		return phaseEventNode;
+	}
+};
+
+// Handed out when publishing an event; cancelling it keeps the event from being dispatched.
+// Cancelling an event waiting in a phase (delayed or not) also destroys it right away, instead of at its cycle.
+class EventToken {
+private:
+	std::shared_ptr<EventCancellationState> state;
+
+public:
+	EventToken() :
+			state()
+	{
+		//This creates a token for no event at all; cancelling it does nothing.
+	}
+
+	EventToken(std::shared_ptr<EventCancellationState> state) :
+			state(std::move(state))
+	{
+	}
+
+	void cancel() {
+		if (state) {
+			state->cancel();
+		}
+	}
+
+	bool isCancelled() const {
+		return state && state->isCancelled();
+	}
+};
@@ -0,0 +1,206 @@
+#pragma once
+
+// Tracing of events from publish to handler, exported as Chrome trace-event JSON (chrome://tracing, Perfetto).
+// Only compiled in with EVENTHANDLING_TRACING defined; without it the EVENT_TRACE_* macros expand to nothing.
+
+#ifdef EVENTHANDLING_TRACING
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+
+class EventTraceRecord {
+public:
+	const char * category;
+	const char * name;
+	char phase; 	// Chrome trace-event phase: 'B'/'E' slice, 'i' instant, 's'/'f' flow.
+	std::uint64_t timestamp; 	// ns since EventTracer::epoch.
+	std::uint64_t id; 	// Flow id, or phase id for phase slices.
+};
+
+// Single producer (the owning thread), single consumer (the exporter); no locks on the recording side.
+class EventTraceBuffer {
+private:
+	static constexpr std::size_t capacity = 1 << 16;
+
+	std::array<EventTraceRecord, capacity> records;
+	std::atomic<std::size_t> head;
+	std::atomic<std::size_t> tail;
+	std::atomic<std::size_t> dropped;
+	unsigned int threadIndex;
+
+public:
+	EventTraceBuffer(unsigned int threadIndex) :
+			head(0),
+			tail(0),
+			dropped(0),
+			threadIndex(threadIndex)
+	{
+	}
+
+	void push(const EventTraceRecord & record) {
+		std::size_t _head = head.load(std::memory_order_relaxed);
+		if (_head - tail.load(std::memory_order_acquire) == capacity) {
+			// Full; drop rather than wait for the exporter.
+			dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+		records[_head % capacity] = record;
+		head.store(_head + 1, std::memory_order_release);
+	}
+
+	template<typename Func>
+	void consume(Func func) {
+		std::size_t _tail = tail.load(std::memory_order_relaxed);
+		std::size_t _head = head.load(std::memory_order_acquire);
+		for (; _tail != _head; _tail++) {
+			func(records[_tail % capacity]);
+		}
+		tail.store(_tail, std::memory_order_release);
+	}
+
+	unsigned int getThreadIndex() const {
+		return threadIndex;
+	}
+
+	std::size_t getDroppedCount() const {
+		return dropped.load(std::memory_order_relaxed);
+	}
+};
+
+class EventTracer {
+private:
+	// Buffers are never freed; they outlive their threads so the exporter can still read them.
+	static inline std::vector<EventTraceBuffer *> buffers;
+	static inline std::mutex buffersMutex;
+	static inline thread_local EventTraceBuffer * threadBuffer = nullptr;
+
+	static inline const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+	static inline std::atomic<std::uint64_t> nextFlowID{1};
+	static inline thread_local std::uint64_t currentFlowID = 0;
+
+public:
+	static void record(char phase, const char * category, const char * name, std::uint64_t id = 0) {
+		if (threadBuffer == nullptr) {
+			_registerThread();
+		}
+		threadBuffer->push(EventTraceRecord{category, name, phase, _now(), id});
+	}
+
+	// At publish; returns the id that follows the event to its dispatch.
+	static std::uint64_t publish(const char * eventName) {
+		std::uint64_t flowID = nextFlowID.fetch_add(1, std::memory_order_relaxed);
+		record('i', "publish", eventName, flowID);
+		record('s', "event", eventName, flowID);
+		return flowID;
+	}
+
+	static std::uint64_t getCurrentFlowID() {
+		return currentFlowID;
+	}
+
+	// Writes everything recorded so far (and not yet exported) as Chrome trace-event JSON.
+	static void exportChromeTrace(std::ostream & output) {
+		buffersMutex.lock();
+		std::vector<EventTraceBuffer *> _buffers = buffers;
+		buffersMutex.unlock();
+
+		bool first = true;
+		output << "{\"traceEvents\":[";
+		for (EventTraceBuffer * buffer : _buffers) {
+			buffer->consume([&output, &first, buffer](const EventTraceRecord & record){
+				output << (first ? "\n" : ",\n");
+				first = false;
+				output << "{\"name\":\"" << record.name << "\",\"cat\":\"" << record.category << "\",\"ph\":\"" << record.phase << "\"";
+				output << ",\"ts\":" << (record.timestamp / 1000) << "." << (record.timestamp % 1000 / 100) << (record.timestamp % 100 / 10) << (record.timestamp % 10);
+				output << ",\"pid\":1,\"tid\":" << buffer->getThreadIndex();
+				if (record.phase == 's' || record.phase == 'f') {
+					output << ",\"id\":" << record.id;
+					if (record.phase == 'f') {
+						output << ",\"bp\":\"e\""; 	// Bind to the dispatch slice it ends in.
+					}
+				} else {
+					output << ",\"args\":{\"id\":" << record.id << "}";
+				}
+				output << "}";
+			});
+		}
+		output << "\n],\"displayTimeUnit\":\"ns\"}\n";
+	}
+
+	static std::size_t getDroppedCount() {
+		std::size_t dropped = 0;
+		buffersMutex.lock();
+		for (EventTraceBuffer * buffer : buffers) {
+			dropped += buffer->getDroppedCount();
+		}
+		buffersMutex.unlock();
+		return dropped;
+	}
+
+	// A slice from construction to destruction.
+	class Scope {
+	private:
+		const char * category;
+		const char * name;
+		std::uint64_t id;
+	public:
+		Scope(const char * category, const char * name, std::uint64_t id = 0) :
+				category(category),
+				name(name),
+				id(id)
+		{
+			record('B', category, name, id);
+		}
+
+		~Scope() {
+			record('E', category, name, id);
+		}
+	};
+
+	// Dispatch of a published event; ends its flow and makes it the current flow for the handlers called from here.
+	class DispatchScope {
+	private:
+		std::uint64_t previousFlowID;
+		Scope scope;
+	public:
+		DispatchScope(const char * eventName, std::uint64_t flowID) :
+				previousFlowID(currentFlowID),
+				scope("dispatch", eventName, flowID)
+		{
+			record('f', "event", eventName, flowID);
+			currentFlowID = flowID;
+		}
+
+		~DispatchScope() {
+			currentFlowID = previousFlowID;
+		}
+	};
+
+private:
+	static std::uint64_t _now() {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+	}
+
+	static void _registerThread() {
+		buffersMutex.lock();
+		threadBuffer = new EventTraceBuffer(buffers.size());
+		buffers.push_back(threadBuffer);
+		buffersMutex.unlock();
+	}
+};
+
+#define EVENT_TRACE_CONCAT_(a, b) a##b
+#define EVENT_TRACE_CONCAT(a, b) EVENT_TRACE_CONCAT_(a, b)
+#define EVENT_TRACE_SCOPE(category, name, id) EventTracer::Scope EVENT_TRACE_CONCAT(eventTraceScope_, __LINE__)(category, name, id)
+
+#else
+
+#define EVENT_TRACE_SCOPE(category, name, id)
+
+#endif
@@ -0,0 +1,139 @@
+#pragma once
+
+#include "PoolAllocator.h"
+
+#include <typeinfo>
+#include <typeindex>
+#include <vector>
+#include <string>
+#include <functional>
+#include <mutex>
+
+
+class EventTypeFootprint {
+private:
+	std::type_index type;
+	std::size_t bytes;
+
+public:
+	EventTypeFootprint(std::type_index type, std::size_t bytes) :
+			type(type),
+			bytes(bytes)
+	{
+	}
+
+	std::type_index getType() const {
+		return type;
+	}
+
+	std::string getName() const {
+		return type.name();
+	}
+
+	std::size_t getBytes() const {
+		return bytes;
+	}
+};
+
+
+// Knows every event type an EventManager<> was instantiated and used for.
+// Footprints and compaction touch the EventManager<> internals, so only use them from the thread running ProcessManager.
+// Subscriptions and cancellation states live in ObjectPool<> slabs shared by all event types; those are reported and
+// compacted here as a whole, apart from the event types.
+class EventTypeRegistry {
+private:
+	class EventTypeEntry {
+	public:
+		std::type_index type;
+		std::function<std::size_t(void)> memoryFootprintFunction;
+		std::function<void(void)> compactFunction;
+	};
+
+	static inline std::vector<EventTypeEntry> eventTypes;
+	static inline std::mutex eventTypesMutex;
+	static inline std::vector<std::function<void(void)>> compactFunctions; 	// Of what is not tied to an event type, like the phases.
+
+	static inline unsigned int idleCompactionThreshold = 0; 	// 0 -> never compact on idle.
+	static inline unsigned int idleRunsSinceCompaction = 0;
+
+public:
+	static void registerEventType(const std::type_info & type, std::function<std::size_t(void)> memoryFootprintFunction, std::function<void(void)> compactFunction) {
+		eventTypesMutex.lock();
+		eventTypes.push_back(EventTypeEntry{std::type_index(type), memoryFootprintFunction, compactFunction});
+		eventTypesMutex.unlock();
+	}
+
+	// Have compactAll() also compact something that is not an event type.
+	static void registerCompaction(std::function<void(void)> compactFunction) {
+		eventTypesMutex.lock();
+		compactFunctions.push_back(compactFunction);
+		eventTypesMutex.unlock();
+	}
+
+	static std::vector<EventTypeFootprint> getMemoryFootprints() {
+		std::vector<EventTypeFootprint> footprints;
+		for (auto & eventType : getEventTypes()) {
+			footprints.emplace_back(eventType.type, eventType.memoryFootprintFunction());
+		}
+		return footprints;
+	}
+
+	// Bytes of the ObjectPool<> slabs, whether their blocks are in use or free.
+	static std::size_t getPooledMemoryFootprint() {
+		return ObjectPools::getMemoryFootprint();
+	}
+
+	// The event types plus the pooled memory.
+	static std::size_t getTotalMemoryFootprint() {
+		std::size_t total = getPooledMemoryFootprint();
+		for (auto & eventType : getEventTypes()) {
+			total += eventType.memoryFootprintFunction();
+		}
+		return total;
+	}
+
+	// Drops invalid subscriptions and shrinks the subscription buffers of every event type, then whatever else registered a
+	// compaction, then gives back the pool slabs that are entirely free again.
+	static void compactAll() {
+		for (auto & eventType : getEventTypes()) {
+			eventType.compactFunction();
+		}
+		eventTypesMutex.lock();
+		std::vector<std::function<void(void)>> _compactFunctions = compactFunctions;
+		eventTypesMutex.unlock();
+		for (auto & _compactFunction : _compactFunctions) {
+			_compactFunction();
+		}
+		ObjectPools::compactAll();
+		idleRunsSinceCompaction = 0;
+	}
+
+	// Compact after this many consecutive ProcessManager::run() calls that had nothing to process; 0 disables it.
+	static void setIdleCompactionThreshold(unsigned int idleRuns) {
+		idleCompactionThreshold = idleRuns;
+		idleRunsSinceCompaction = 0;
+	}
+
+	static void notifyIdle() {
+		if (idleCompactionThreshold == 0) {
+			return;
+		}
+		idleRunsSinceCompaction++;
+		if (idleRunsSinceCompaction == idleCompactionThreshold) {
+			compactAll();
+		}
+	}
+
+	static void notifyBusy() {
+		idleRunsSinceCompaction = 0;
+	}
+
+private:
+	static std::vector<EventTypeEntry> getEventTypes() {
+		// Copy, so registering types from within a footprint/compaction call can't invalidate what we iterate over.
+		eventTypesMutex.lock();
+		std::vector<EventTypeEntry> _eventTypes = eventTypes;
+		eventTypesMutex.unlock();
+		return _eventTypes;
+	}
+};
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include <utility>
+
+
+// Bump allocator; everything allocated from it is given back at once with reset(), which keeps the chunks for the next round.
+// Objects created in it are not destroyed by the arena; whoever creates them destroys them before the reset.
+class FrameArena {
+private:
+	class Chunk {
+	public:
+		std::unique_ptr<std::byte[]> data;
+		std::size_t size;
+	};
+
+	std::vector<Chunk> chunks;
+	std::size_t chunkIndex;
+	std::size_t chunkOffset;
+	std::size_t chunkSize;
+
+public:
+	FrameArena(std::size_t chunkSize = 16 * 1024) :
+			chunkIndex(0),
+			chunkOffset(0),
+			chunkSize(chunkSize)
+	{
+	}
+
+	void * allocate(std::size_t size, std::size_t alignment) {
+		while (chunkIndex < chunks.size()) {
+			Chunk & chunk = chunks[chunkIndex];
+			std::size_t alignedOffset = _alignedOffset(chunk, alignment);
+			if (alignedOffset + size <= chunk.size) {
+				chunkOffset = alignedOffset + size;
+				return chunk.data.get() + alignedOffset;
+			}
+			// Doesn't fit; move on to the next chunk.
+			chunkIndex++;
+			chunkOffset = 0;
+		}
+
+		// Out of chunks; add one big enough for this allocation.
+		std::size_t newChunkSize = std::max(chunkSize, size + alignment);
+		chunks.push_back(Chunk{std::make_unique<std::byte[]>(newChunkSize), newChunkSize});
+		chunkIndex = chunks.size() - 1;
+		chunkOffset = 0;
+		Chunk & chunk = chunks.back();
+		std::size_t alignedOffset = _alignedOffset(chunk, alignment);
+		chunkOffset = alignedOffset + size;
+		return chunk.data.get() + alignedOffset;
+	}
+
+	template<typename U, typename... Arguments>
+	U * create(Arguments&&... arguments) {
+		return new (allocate(sizeof(U), alignof(U))) U(std::forward<Arguments>(arguments)...);
+	}
+
+	void reset() {
+		chunkIndex = 0;
+		chunkOffset = 0;
+	}
+
+	std::size_t getCapacity() const {
+		std::size_t capacity = 0;
+		for (const Chunk & chunk : chunks) {
+			capacity += chunk.size;
+		}
+		return capacity;
+	}
+
+	// Give back all chunks but the first; only valid right after a reset().
+	void shrink() {
+		if (chunks.size() > 1) {
+			chunks.resize(1);
+		}
+	}
+
+private:
+	std::size_t _alignedOffset(const Chunk & chunk, std::size_t alignment) const {
+		std::uintptr_t address = reinterpret_cast<std::uintptr_t>(chunk.data.get()) + chunkOffset;
+		std::uintptr_t alignedAddress = (address + alignment - 1) & ~(static_cast<std::uintptr_t>(alignment) - 1);
+		return chunkOffset + (alignedAddress - address);
+	}
+};
@@ -0,0 +1,133 @@
+#pragma once
+
+#include "Key.h"
+
+#include <unordered_map>
+#include <shared_mutex>
+#include <optional>
+#include <variant>
+#include <cstdint>
+#include <cstddef>
+#include <type_traits>
+
+// Compact handle for an interned Key; index into the keyed subscription tables.
+class KeyId {
+private:
+	std::uint32_t index;
+
+public:
+	explicit KeyId(std::uint32_t index) :
+			index(index)
+	{
+	}
+
+	std::uint32_t getIndex() const {
+		return index;
+	}
+
+	bool operator==(const KeyId & rhs) const {
+		return index == rhs.index;
+	}
+};
+
+// A key as a publisher hands it over: its KeyId if the key was interned by then, otherwise the key itself, to be looked up again
+// once the event is managed; someone may subscribe to the key in between.
+class PublishedKey {
+private:
+	std::variant<KeyId, Key> key;
+
+public:
+	explicit PublishedKey(KeyId keyId) :
+			key(keyId)
+	{
+	}
+
+	explicit PublishedKey(Key key) :
+			key(std::move(key))
+	{
+	}
+
+	// The KeyId it was published with, if any; doesn't look anything up.
+	std::optional<KeyId> getKeyId() const {
+		if (const KeyId * keyId = std::get_if<KeyId>(&key)) {
+			return *keyId;
+		}
+		return std::nullopt;
+	}
+
+	// The key's id if it is interned now; nobody subscribed to it otherwise. Defined after KeyRegistry.
+	std::optional<KeyId> find() const;
+};
+
+// Hands out one KeyId per distinct key, for the lifetime of the process. Only subscribing interns keys; publishing merely
+// looks them up, so the registry holds the keys subscribed to rather than every key ever published.
+// Both hash and lock; publishers and subscribers that keep the KeyId skip both.
+class KeyRegistry {
+private:
+	static inline std::unordered_map<Key, KeyId> keyIds;
+	static inline std::shared_mutex keyIdsMutex; 	// Shared by the lookups of the publishers.
+
+public:
+	template<typename KeyInputType>
+	static KeyId intern(const KeyInputType & keyInput) {
+		if constexpr (std::is_same_v<KeyInputType, KeyId>) {
+			return keyInput;
+		} else {
+			Key key(keyInput);
+
+			keyIdsMutex.lock();
+			KeyId keyId = keyIds.try_emplace(std::move(key), KeyId(static_cast<std::uint32_t>(keyIds.size()))).first->second;
+			keyIdsMutex.unlock();
+
+			return keyId;
+		}
+	}
+
+	// The key's id if it was interned; nobody subscribed to it otherwise.
+	template<typename KeyInputType>
+	static std::optional<KeyId> find(const KeyInputType & keyInput) {
+		if constexpr (std::is_same_v<KeyInputType, KeyId>) {
+			return keyInput;
+		} else if constexpr (std::is_same_v<KeyInputType, Key>) {
+			return _find(keyInput);
+		} else {
+			return _find(Key(keyInput));
+		}
+	}
+
+	// Like find(), but keeps the key when it isn't interned yet, so it can be looked up again later; see PublishedKey.
+	template<typename KeyInputType>
+	static PublishedKey publish(const KeyInputType & keyInput) {
+		if constexpr (std::is_same_v<KeyInputType, KeyId>) {
+			return PublishedKey(keyInput);
+		} else {
+			Key key(keyInput);
+			std::optional<KeyId> keyId = _find(key);
+			return keyId ? PublishedKey(*keyId) : PublishedKey(std::move(key));
+		}
+	}
+
+	static std::size_t getKeyCount() {
+		keyIdsMutex.lock_shared();
+		std::size_t keyCount = keyIds.size();
+		keyIdsMutex.unlock_shared();
+		return keyCount;
+	}
+
+private:
+	static std::optional<KeyId> _find(const Key & key) {
+		keyIdsMutex.lock_shared();
+		auto keyIdIterator = keyIds.find(key);
+		std::optional<KeyId> keyId = (keyIdIterator != keyIds.end()) ? std::optional<KeyId>(keyIdIterator->second) : std::nullopt;
+		keyIdsMutex.unlock_shared();
+
+		return keyId;
+	}
+};
+
+inline std::optional<KeyId> PublishedKey::find() const {
+	if (const KeyId * keyId = std::get_if<KeyId>(&key)) {
+		return *keyId;
+	}
+	return KeyRegistry::find(std::get<Key>(key));
+}
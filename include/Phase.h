@@ -1,18 +1,197 @@
 #pragma once
 
-#include <queue>
+#include "FrameArena.h"
+#include "EventTracer.h"
+#include "EventToken.h"
+
+#include <deque>
+#include <map>
+#include <vector>
 #include <functional>
 #include <mutex>
+#include <utility>
+#include <atomic>
+#include <cstdint>
+#include <chrono>
+#include <algorithm>
+#include <memory>
+#include <type_traits>
 
 typedef unsigned int PhaseID;
 
 #define NOW (0)
 #define NEXT (1)
 
+// A call to make during a phase, placed in the arena of the cycle it is scheduled for; the callable follows right after it.
+class PhaseEventNode {
+public:
+	enum Status_e {
+		e_Pending,
+		e_Taken, 	// Picked up by the run; the callable is destroyed with the cycle.
+		e_Destroyed
+	};
+
+	void (*invokeFunction)(PhaseEventNode *);
+	void (*destroyFunction)(PhaseEventNode *);
+	PhaseEventNode * (*relocateFunction)(PhaseEventNode *, FrameArena &); 	// Moves it into another arena; returns the new node.
+	Status_e status;
+};
+
+template <typename Callable>
+class PhaseEventNodeWith : public PhaseEventNode {
+public:
+	Callable callable;
+
+	PhaseEventNodeWith(Callable && callable) :
+			callable(std::move(callable))
+	{
+		invokeFunction = [](PhaseEventNode * node){ static_cast<PhaseEventNodeWith<Callable> *>(node)->callable(); };
+		destroyFunction = [](PhaseEventNode * node){ static_cast<PhaseEventNodeWith<Callable> *>(node)->~PhaseEventNodeWith<Callable>(); };
+		relocateFunction = [](PhaseEventNode * node, FrameArena & arena) -> PhaseEventNode * {
+			PhaseEventNodeWith<Callable> * _node = static_cast<PhaseEventNodeWith<Callable> *>(node);
+			PhaseEventNodeWith<Callable> * relocatedNode = arena.create<PhaseEventNodeWith<Callable>>(std::move(_node->callable));
+			_node->~PhaseEventNodeWith<Callable>();
+			if constexpr (requires { relocatedNode->callable.relocatedTo(relocatedNode); }) {
+				relocatedNode->callable.relocatedTo(relocatedNode);
+			}
+			return relocatedNode;
+		};
+		status = e_Pending;
+	}
+};
+
+// Handle to a PhaseEventNode; cheap to copy around. All but invoke() are called with the phase's lock held.
+class PhaseEventCall {
+private:
+	PhaseEventNode * node;
+
+public:
+	template<typename Callable>
+	static PhaseEventCall create(FrameArena & arena, Callable && callable) {
+		PhaseEventCall phaseEventCall;
+		phaseEventCall.node = arena.create<PhaseEventNodeWith<std::decay_t<Callable>>>(std::decay_t<Callable>(std::forward<Callable>(callable)));
+		return phaseEventCall;
+	}
+
+	static PhaseEventCall fromNode(PhaseEventNode * node) {
+		PhaseEventCall phaseEventCall;
+		phaseEventCall.node = node;
+		return phaseEventCall;
+	}
+
+	PhaseEventNode * getNode() const {
+		return node;
+	}
+
+	// True if this run gets to invoke it; false if it was cancelled.
+	bool take() {
+		if (node->status != PhaseEventNode::e_Pending) {
+			return false;
+		}
+		node->status = PhaseEventNode::e_Taken;
+		return true;
+	}
+
+	void invoke() {
+		node->invokeFunction(node);
+	}
+
+	void destroy() {
+		if (node->status != PhaseEventNode::e_Destroyed) {
+			node->status = PhaseEventNode::e_Destroyed;
+			node->destroyFunction(node);
+		}
+	}
+
+	bool isPending() const {
+		return node->status == PhaseEventNode::e_Pending;
+	}
+
+	// Moves a pending call into 'arena'; what is left of it in its old arena can be reset along with that arena.
+	void relocate(FrameArena & arena) {
+		node = node->relocateFunction(node, arena);
+	}
+
+	// Destroy it now if it didn't get picked up yet; it stays behind in its cycle as an empty entry.
+	void cancel() {
+		if (node->status == PhaseEventNode::e_Pending) {
+			destroy();
+		}
+	}
+};
+
+// Wraps a phase call that was handed out an EventToken; keeps the token informed of where the call lives.
+template <typename Callable>
+class CancellablePhaseCall {
+private:
+	std::shared_ptr<EventCancellationState> cancellationState;
+	Callable callable;
+
+public:
+	CancellablePhaseCall(std::shared_ptr<EventCancellationState> cancellationState, Callable && callable) :
+			cancellationState(std::move(cancellationState)),
+			callable(std::move(callable))
+	{
+	}
+
+	CancellablePhaseCall(CancellablePhaseCall && other) = default; 	// Leaves 'other' without a state, so it doesn't detach it.
+
+	~CancellablePhaseCall() {
+		if (cancellationState) {
+			cancellationState->detachPhaseEventNode();
+		}
+	}
+
+	void operator()() {
+		if (!cancellationState->isCancelled()) {
+			callable();
+		}
+	}
+
+	void relocatedTo(PhaseEventNode * node) {
+		cancellationState->movePhaseEventNode(node);
+	}
+};
+
+// Everything scheduled for one run of a phase. Cleared in bulk after the run and reused for a later cycle.
+class PhaseCycle {
+public:
+	FrameArena arena;
+	std::vector<PhaseEventCall> eventCalls;
+
+	void clear() {
+		for (PhaseEventCall & eventCall : eventCalls) {
+			eventCall.destroy();
+		}
+		eventCalls.clear();
+		arena.reset();
+	}
+};
+
 class Phase {
 private:
-	std::queue<std::function<void(void)>> eventManagementFunctionCalls;
-	std::recursive_mutex eventManagementFunctionCallsMutex;
+	PhaseID phaseID;
+
+	// cycles[0] is the cycle run next; cycles[n] the one n runs later. Only the near cycles are kept in line; those further
+	// ahead are held by the run they are due in, and only join the others once they are near.
+	static constexpr unsigned int nearCycleCount = 16;
+	std::deque<PhaseCycle> cycles;
+	std::map<std::uint64_t, PhaseCycle> farCycles;
+	std::uint64_t runCount; 	// Runs so far; cycles[n] is due in run 'runCount + n'.
+	std::recursive_mutex cyclesMutex;
+	std::atomic<std::uint64_t> contendedCyclesLocks;
+
+	// Budget per run; whatever is left when it runs out is deferred to the next run, ahead of that run's own events.
+	std::size_t eventBudget; 	// 0 -> no limit.
+	std::chrono::nanoseconds timeBudget; 	// 0 -> no limit.
+	std::chrono::nanoseconds adaptiveTargetDuration; 	// 0 -> off; otherwise the event budget follows from the measured cost per event.
+	double averageEventCost; 	// ns; only measured in adaptive mode.
+	std::atomic<std::uint64_t> deferredEventCount;
+	std::size_t lastRunDeferredEventCount;
+
+	// Calls requested while this phase runs, to be made once it ran out of events.
+	std::vector<std::function<void(void)>> runEndCalls;
+	static inline thread_local Phase * runningPhase = nullptr;
 
 	std::function<void(void)> phaseStartCallback;
 	std::recursive_mutex phaseStartCallbackMutex;
@@ -20,17 +199,159 @@ private:
 	std::recursive_mutex phaseEndCallbackMutex;
 
 public:
-	void addToQueue(std::function<void(void)> eventManagementFunctionCall) {
-		eventManagementFunctionCallsMutex.lock();
-		eventManagementFunctionCalls.push(eventManagementFunctionCall);
-		eventManagementFunctionCallsMutex.unlock();
+	Phase(PhaseID phaseID = 0) :
+			phaseID(phaseID),
+			cycles(1),
+			runCount(0),
+			contendedCyclesLocks(0),
+			eventBudget(0),
+			timeBudget(0),
+			adaptiveTargetDuration(0),
+			averageEventCost(0.0),
+			deferredEventCount(0),
+			lastRunDeferredEventCount(0)
+	{
+	}
+
+	~Phase() {
+		for (PhaseCycle & cycle : cycles) {
+			cycle.clear();
+		}
+		for (auto & [dueRun, cycle] : farCycles) {
+			cycle.clear();
+		}
+	}
+
+	// offset: 0 -> this (or the upcoming) run; 1 -> the run after that; etc.
+	template<typename Callable>
+	void addToQueue(unsigned int offset, Callable && eventManagementFunctionCall) {
+		_lockCycles();
+		PhaseCycle & cycle = _getCycle(offset);
+		cycle.eventCalls.push_back(PhaseEventCall::create(cycle.arena, std::forward<Callable>(eventManagementFunctionCall)));
+		cyclesMutex.unlock();
+	}
+
+	// Like addToQueue(), but the call can be withdrawn through 'cancellationState' until it is picked up.
+	template<typename Callable>
+	void addToQueue(unsigned int offset, Callable && eventManagementFunctionCall, std::shared_ptr<EventCancellationState> cancellationState) {
+		EventCancellationState * _cancellationState = cancellationState.get();
+
+		_lockCycles();
+		PhaseCycle & cycle = _getCycle(offset);
+		PhaseEventCall eventCall = PhaseEventCall::create(cycle.arena, CancellablePhaseCall<std::decay_t<Callable>>(std::move(cancellationState), std::decay_t<Callable>(std::forward<Callable>(eventManagementFunctionCall))));
+		cycle.eventCalls.push_back(eventCall);
+		_cancellationState->attachPhaseEventNode(this, eventCall.getNode());
+		cyclesMutex.unlock();
+	}
+
+	// O(1): the call is destroyed in place and skipped when its cycle runs.
+	void cancel(EventCancellationState & cancellationState) {
+		_lockCycles();
+		PhaseEventNode * node = cancellationState.getPhaseEventNode();
+		if (node != nullptr) {
+			PhaseEventCall eventCall = PhaseEventCall::fromNode(node);
+			eventCall.cancel(); 	// Detaches 'cancellationState' as the call gets destroyed.
+		}
+		cyclesMutex.unlock();
+	}
+
+	static bool isRunningPhase() {
+		return runningPhase != nullptr;
+	}
+
+	// Only valid while a phase runs on this thread; the call is made at the end of that run, before the phase end callback.
+	template<typename Func, typename... Bindables>
+	static void requestAtRunEnd(Func func, Bindables... bindables) {
+		runningPhase->runEndCalls.push_back(std::bind(func, bindables...));
+	}
+
+	PhaseID getPhaseID() const {
+		return phaseID;
+	}
+
+	// Number of times taking the lock on the scheduled events had to wait for another thread.
+	std::uint64_t getContendedLockCount() const {
+		return contendedCyclesLocks.load(std::memory_order_relaxed);
+	}
+
+	// At most this many events per run; 0 -> no limit.
+	void setEventBudget(std::size_t eventBudget) {
+		_lockCycles();
+		this->eventBudget = eventBudget;
+		cyclesMutex.unlock();
+	}
+
+	// Stop taking new events once a run took this long; 0 -> no limit.
+	void setTimeBudget(std::chrono::nanoseconds timeBudget) {
+		_lockCycles();
+		this->timeBudget = timeBudget;
+		cyclesMutex.unlock();
+	}
+
+	// Aim for runs of this duration by deriving the event budget from the measured cost per event; 0 -> off.
+	void setAdaptiveBudget(std::chrono::nanoseconds targetDuration) {
+		_lockCycles();
+		adaptiveTargetDuration = targetDuration;
+		averageEventCost = 0.0;
+		cyclesMutex.unlock();
+	}
+
+	// Total number of events deferred to a later run because the budget ran out.
+	std::uint64_t getDeferredEventCount() const {
+		return deferredEventCount.load(std::memory_order_relaxed);
+	}
+
+	std::size_t getLastRunDeferredEventCount() {
+		_lockCycles();
+		std::size_t _lastRunDeferredEventCount = lastRunDeferredEventCount;
+		cyclesMutex.unlock();
+		return _lastRunDeferredEventCount;
+	}
+
+	// Arenas held for scheduled events, one per cycle, and their capacity in bytes; both stay at what the busiest runs needed
+	// until compact().
+	std::size_t getArenaCount() {
+		_lockCycles();
+		std::size_t arenaCount = cycles.size() + farCycles.size();
+		cyclesMutex.unlock();
+		return arenaCount;
+	}
+
+	std::size_t getArenaCapacity() {
+		_lockCycles();
+		std::size_t arenaCapacity = 0;
+		for (const PhaseCycle & cycle : cycles) {
+			arenaCapacity += cycle.arena.getCapacity();
+		}
+		for (const auto & [dueRun, cycle] : farCycles) {
+			arenaCapacity += cycle.arena.getCapacity();
+		}
+		cyclesMutex.unlock();
+		return arenaCapacity;
+	}
+
+	// Drops the cycles at the back that have nothing scheduled, and shrinks the arenas of the other empty ones to a chunk.
+	void compact() {
+		_lockCycles();
+		while (cycles.size() > 1 && cycles.back().eventCalls.empty()) {
+			cycles.pop_back();
+		}
+		for (PhaseCycle & cycle : cycles) {
+			if (cycle.eventCalls.empty()) {
+				cycle.arena.reset();
+				cycle.arena.shrink();
+			}
+		}
+		cyclesMutex.unlock();
 	}
 
 	bool hasEventsInQueue() const {
-		return !eventManagementFunctionCalls.empty();
+		return !cycles.front().eventCalls.empty();
 	}
 
 	void run() {
+		EVENT_TRACE_SCOPE("phase", "Phase", phaseID);
+
 		// Call phase start callback.
 		phaseStartCallbackMutex.lock();
 		if (phaseStartCallback) {
@@ -39,22 +360,61 @@ public:
 		phaseStartCallbackMutex.unlock();
 
 		// Call events until there are no more events.
-		eventManagementFunctionCallsMutex.lock();
-		while(!eventManagementFunctionCalls.empty()) {
-			// Copy the function to call.
-			std::function<void(void)> eventManagementFunctionCall = eventManagementFunctionCalls.front();
-			// Remove the function from the queue
-			eventManagementFunctionCalls.pop();
-			eventManagementFunctionCallsMutex.unlock();
+		Phase * previousRunningPhase = runningPhase;
+		runningPhase = this;
+		_lockCycles();
+		PhaseCycle & cycle = cycles.front(); 	// Stays put; the deque only grows at the back while running.
+		std::size_t runEventBudget = _getRunEventBudget();
+		std::chrono::nanoseconds runTimeBudget = _getRunTimeBudget();
+		std::chrono::steady_clock::time_point runStart = std::chrono::steady_clock::now();
+		std::size_t i = 0;
+		std::size_t invoked = 0;
+		for (; i < cycle.eventCalls.size(); i++) {
+			// Out of budget? Always make some progress though.
+			if (invoked > 0 && (invoked >= runEventBudget || (runTimeBudget.count() > 0 && std::chrono::steady_clock::now() - runStart >= runTimeBudget))) {
+				break;
+			}
 
-			// Call the function
-			if (eventManagementFunctionCall) {
-				eventManagementFunctionCall();
+			// Copy the call; the vector may grow while the call runs.
+			PhaseEventCall eventManagementFunctionCall = cycle.eventCalls[i];
+			if (!eventManagementFunctionCall.take()) {
+				continue; 	// Cancelled.
 			}
-			eventManagementFunctionCallsMutex.lock();
+			cyclesMutex.unlock();
+
+			// Call the function
+			eventManagementFunctionCall.invoke();
+			invoked++;
+			_lockCycles();
 		}
 		//Any events registered at this point and after will be executed next cycle. "Too late!"
-		eventManagementFunctionCallsMutex.unlock();
+		_updateAverageEventCost(invoked, std::chrono::steady_clock::now() - runStart);
+
+		if (i < cycle.eventCalls.size()) {
+			_deferRemainingEventCalls(cycle, i);
+		} else {
+			lastRunDeferredEventCount = 0;
+		}
+
+		// Release the whole cycle at once and move on to the next one; the emptied cycle is reused as the last one.
+		cycle.clear();
+		if (cycles.size() > 1) {
+			cycles.push_back(std::move(cycles.front()));
+			cycles.pop_front();
+		}
+		runCount++;
+		_pullInFarCycle();
+		cyclesMutex.unlock();
+
+		// Calls that waited for the end of the run; these may request more of them.
+		while (!runEndCalls.empty()) {
+			std::vector<std::function<void(void)>> _runEndCalls;
+			std::swap(runEndCalls, _runEndCalls);
+			for (auto & _runEndCall : _runEndCalls) {
+				_runEndCall();
+			}
+		}
+		runningPhase = previousRunningPhase;
 
 		// Call phase end callback.
 		phaseEndCallbackMutex.lock();
@@ -75,4 +435,96 @@ public:
 		this->phaseEndCallback = phaseEndCallback;
 		phaseEndCallbackMutex.unlock();
 	}
+
+private:
+	void _lockCycles() {
+		if (!cyclesMutex.try_lock()) {
+			contendedCyclesLocks.fetch_add(1, std::memory_order_relaxed);
+			cyclesMutex.lock();
+		}
+	}
+
+	PhaseCycle & _getCycle(unsigned int offset) {
+		if (offset >= nearCycleCount) {
+			return farCycles[runCount + offset];
+		}
+		while (cycles.size() <= offset) {
+			cycles.emplace_back();
+		}
+		return cycles[offset];
+	}
+
+	// Moves the far cycle that just became near in line with the others; called with 'cyclesMutex' held after each run.
+	// Nothing could be scheduled for that run through the near cycles yet, so its place in line is still empty.
+	void _pullInFarCycle() {
+		auto farCycle = farCycles.find(runCount + nearCycleCount - 1);
+		if (farCycle == farCycles.end()) {
+			return;
+		}
+		std::swap(_getCycle(nearCycleCount - 1), farCycle->second); 	// The calls stay in the arena they were made in.
+		farCycles.erase(farCycle);
+	}
+
+	std::size_t _getRunEventBudget() const {
+		std::size_t runEventBudget = (eventBudget > 0) ? eventBudget : SIZE_MAX;
+		if (adaptiveTargetDuration.count() > 0 && averageEventCost > 0.0) {
+			std::size_t adaptiveEventBudget = std::max<std::size_t>(1, static_cast<std::size_t>(adaptiveTargetDuration.count() / averageEventCost));
+			runEventBudget = std::min(runEventBudget, adaptiveEventBudget);
+		}
+		return runEventBudget;
+	}
+
+	std::chrono::nanoseconds _getRunTimeBudget() const {
+		// Adaptive mode without a measurement yet falls back on watching the clock.
+		if (adaptiveTargetDuration.count() > 0 && averageEventCost == 0.0 && (timeBudget.count() == 0 || adaptiveTargetDuration < timeBudget)) {
+			return adaptiveTargetDuration;
+		}
+		return timeBudget;
+	}
+
+	void _updateAverageEventCost(std::size_t eventCount, std::chrono::steady_clock::duration runDuration) {
+		if (adaptiveTargetDuration.count() == 0 || eventCount == 0) {
+			return;
+		}
+		double eventCost = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(runDuration).count()) / eventCount;
+		averageEventCost = (averageEventCost == 0.0) ? eventCost : (0.8 * averageEventCost + 0.2 * eventCost);
+	}
+
+	// Moves the calls from 'firstDeferred' on to the front of the next cycle, in order; called with 'cyclesMutex' held.
+	// They are moved into the next cycle's arena, so this cycle's arena is reset as usual, however long the deferral goes on.
+	void _deferRemainingEventCalls(PhaseCycle & cycle, std::size_t firstDeferred) {
+		if (cycles.size() == 1) {
+			cycles.emplace_back();
+		}
+		PhaseCycle & nextCycle = cycles[1];
+
+		for (std::size_t i = 0; i < firstDeferred; i++) {
+			cycle.eventCalls[i].destroy();
+		}
+
+		// Cancelled calls are left behind.
+		std::size_t deferred = 0;
+		for (std::size_t i = firstDeferred; i < cycle.eventCalls.size(); i++) {
+			PhaseEventCall eventCall = cycle.eventCalls[i];
+			if (eventCall.isPending()) {
+				eventCall.relocate(nextCycle.arena);
+				cycle.eventCalls[firstDeferred + deferred] = eventCall;
+				deferred++;
+			}
+		}
+		nextCycle.eventCalls.insert(nextCycle.eventCalls.begin(), cycle.eventCalls.begin() + firstDeferred, cycle.eventCalls.begin() + firstDeferred + deferred);
+		cycle.eventCalls.clear();
+
+		lastRunDeferredEventCount = deferred;
+		deferredEventCount.fetch_add(deferred, std::memory_order_relaxed);
+	}
 };
+
+inline void EventCancellationState::cancel() {
+	cancelled.store(true, std::memory_order_release);
+
+	// Scheduled in a phase? Take it out of there right away.
+	if (phase != nullptr) {
+		phase->cancel(*this);
+	}
+}
@@ -6,45 +6,18 @@
 #include <unordered_map>
 #include <queue>
 #include <functional>
-
-
-class DelayedPhaseEvent {
-private:
-	PhaseID phaseID;
-	unsigned int offset; 	//TODO: refactor this.
-	std::function<void(void)> eventManagementFunction;
-public:
-	DelayedPhaseEvent(PhaseID phaseID, unsigned int offset, std::function<void(void)> eventManagementFunction) :
-			phaseID(phaseID),
-			offset(offset),
-			eventManagementFunction(eventManagementFunction)
-	{
-	}
-
-	PhaseID getPhaseID() const {
-		return phaseID;
-	}
-
-	std::function<void(void)> getEventManagementFunction() const {
-		return eventManagementFunction;
-	}
-
-	unsigned int getOffset() const {
-		return offset;
-	}
-
-	void decrementOffset() {
-		offset--;
-	}
-};
+#include <mutex>
+#include <cstdint>
+#include <chrono>
+#include <memory>
 
 
 class PhaseManager {
 private:
 	static inline std::unordered_map<PhaseID, Phase> phaseMap;
+	static inline std::mutex phaseMapMutex; 	// Events get registered from any thread; guards the map itself, Phase guards its own content.
 	static inline std::queue<PhaseID> phaseQueue;
-
-	static inline std::unordered_map<PhaseID, std::vector<DelayedPhaseEvent>> delayedPhaseEventMap;
+	static inline bool compactionRegistered = false; 	// With EventTypeRegistry, once the first phase is made.
 
 	static inline std::function<void(void)> phaseQueueEmptyCallback;
 
@@ -59,43 +32,8 @@ public:
 		PhaseID phaseID = phaseQueue.front();
 		phaseQueue.pop();
 
-		// Execute the corresponding phase.
-		phaseMap[phaseID].run();
-
-		// Update the delayed phase events; and schedule them if necessary.
-		if(delayedPhaseEventMap.contains(phaseID)) {
-			// Get the appropriate delayed phase events.
-			auto & delayedPhaseEvents = delayedPhaseEventMap[phaseID];
-
-			// Decrement the countdown/offset of the delayed phase events; and if that is 0, schedule them.
-			for (DelayedPhaseEvent & delayedPhaseEvent : delayedPhaseEvents) {
-				// Decrement the countdown/offset.
-				delayedPhaseEvent.decrementOffset();
-
-				// Check if they can be scheduled.
-				if (delayedPhaseEvent.getOffset() == 0) {
-					// Schedule.
-					phaseMap[phaseID].addToQueue(delayedPhaseEvent.getEventManagementFunction());
-				}
-			}
-
-			// Clear the scheduled delayed phase events.
-			delayedPhaseEvents.erase(
-				std::remove_if(
-					delayedPhaseEvents.begin(),
-					delayedPhaseEvents.end(),
-					[](DelayedPhaseEvent & delayedPhaseEvent) {
-						return delayedPhaseEvent.getOffset() == 0; 	// If it is 0, then it was scheduled above.
-					}
-				),
-				delayedPhaseEvents.end()
-			);
-			
-			// If there are no more delayed phase events, remove the empty vector from the 'delayedPhaseEventMap'.
-			if (delayedPhaseEvents.empty()) {
-				delayedPhaseEventMap.erase(phaseID);
-			}
-		}
+		// Execute the corresponding phase; this also moves its delayed events one cycle closer.
+		_getPhase(phaseID).run();
 
 		// If there's more phases to execute, schedule their execution.
 		// NOTE: Scheduling the next phase execution here gives non-phased events priority over phased events.
@@ -119,6 +57,27 @@ public:
 		requestManagingProcessPhases();
 	}
 
+	// Number of times a phase's lock on its scheduled events had to wait for another thread, over all phases.
+	static std::uint64_t getContendedLockCount() {
+		std::uint64_t contendedLocks = 0;
+		phaseMapMutex.lock();
+		for (auto & [phaseID, phase] : phaseMap) {
+			contendedLocks += phase.getContendedLockCount();
+		}
+		phaseMapMutex.unlock();
+		return contendedLocks;
+	}
+
+	// Gives back the arena memory of the cycles that have nothing scheduled; see Phase::compact(). Also done by
+	// EventTypeRegistry::compactAll().
+	static void compact() {
+		phaseMapMutex.lock();
+		for (auto & [phaseID, phase] : phaseMap) {
+			phase.compact();
+		}
+		phaseMapMutex.unlock();
+	}
+
 	static void setPhaseQueueEmptyCallback(std::function<void(void)> phaseQueueEmptyCallback) {
 		PhaseManager::phaseQueueEmptyCallback = phaseQueueEmptyCallback;
 		// if (phaseQueue.empty()) {
@@ -129,22 +88,62 @@ public:
 	}
 
 	static void setPhaseStartCallback(PhaseID phaseID, std::function<void(void)> phaseStartCallback) {
-		phaseMap[phaseID].setPhaseStartCallback(phaseStartCallback);
+		_getPhase(phaseID).setPhaseStartCallback(phaseStartCallback);
 	}
 
 	static void setPhaseEndCallback(PhaseID phaseID, std::function<void(void)> phaseEndCallback) {
-		phaseMap[phaseID].setPhaseEndCallback(phaseEndCallback);
+		_getPhase(phaseID).setPhaseEndCallback(phaseEndCallback);
+	}
+
+	static void setPhaseEventBudget(PhaseID phaseID, std::size_t eventBudget) {
+		_getPhase(phaseID).setEventBudget(eventBudget);
+	}
+
+	static void setPhaseTimeBudget(PhaseID phaseID, std::chrono::nanoseconds timeBudget) {
+		_getPhase(phaseID).setTimeBudget(timeBudget);
+	}
+
+	static void setPhaseAdaptiveBudget(PhaseID phaseID, std::chrono::nanoseconds targetDuration) {
+		_getPhase(phaseID).setAdaptiveBudget(targetDuration);
+	}
+
+	static std::uint64_t getDeferredEventCount(PhaseID phaseID) {
+		return _getPhase(phaseID).getDeferredEventCount();
 	}
 
 	static void registerEventCallback(PhaseID phaseID, unsigned int offset, std::function<void(void)> eventManagementFunction) {
-		if (offset > 0) {
-			delayedPhaseEventMap[phaseID].emplace_back(phaseID, offset, eventManagementFunction);
-		} else {
-			phaseMap[phaseID].addToQueue(eventManagementFunction);
-		}
+		registerEventCall(phaseID, offset, [eventManagementFunction](){
+			if (eventManagementFunction) {
+				eventManagementFunction();
+			}
+		});
+	}
+
+	// Like registerEventCallback(), but stores the callable itself in the frame arena of the phase cycle it is scheduled for.
+	template<typename Callable>
+	static void registerEventCall(PhaseID phaseID, unsigned int offset, Callable && eventManagementCall) {
+		_getPhase(phaseID).addToQueue(offset, std::forward<Callable>(eventManagementCall));
+	}
+
+	// Like registerEventCall(), but the call can be withdrawn (and is destroyed right away) through 'cancellationState'.
+	template<typename Callable>
+	static void registerEventCall(PhaseID phaseID, unsigned int offset, Callable && eventManagementCall, std::shared_ptr<EventCancellationState> cancellationState) {
+		_getPhase(phaseID).addToQueue(offset, std::forward<Callable>(eventManagementCall), std::move(cancellationState));
 	}
 
 private:
+	static Phase & _getPhase(PhaseID phaseID) {
+		// Phases don't move once in the map, so the reference stays good after unlocking.
+		phaseMapMutex.lock();
+		Phase & phase = phaseMap.try_emplace(phaseID, phaseID).first->second;
+		if (!compactionRegistered) {
+			compactionRegistered = true;
+			EventTypeRegistry::registerCompaction(&PhaseManager::compact);
+		}
+		phaseMapMutex.unlock();
+		return phase;
+	}
+
 	static void requestManagingProcessPhases() {
 		ProcessManager::requestProcess(&PhaseManager::managePhases);
 	}
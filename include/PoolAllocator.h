@@ -0,0 +1,291 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include <functional>
+
+
+// All ObjectPool<T> together; std::allocate_shared pools its own control block types, which can't be named from outside.
+class ObjectPools {
+	template <typename> friend class ObjectPool;
+
+private:
+	static inline std::atomic<std::size_t> slabCount{0};
+	static inline std::atomic<std::size_t> slabBytes{0};
+
+	static inline std::vector<void (*)(void)> compactFunctions; 	// One per pool that ever had a slab.
+	static inline std::mutex compactFunctionsMutex;
+
+public:
+	static std::size_t getSlabCount() {
+		return slabCount.load(std::memory_order_relaxed);
+	}
+
+	// Bytes held in slabs, by live objects and free blocks alike.
+	static std::size_t getMemoryFootprint() {
+		return slabBytes.load(std::memory_order_relaxed);
+	}
+
+	// Gives back the slabs all blocks of which are free; see ObjectPool<T>::compact().
+	static void compactAll() {
+		compactFunctionsMutex.lock();
+		std::vector<void (*)(void)> _compactFunctions = compactFunctions;
+		compactFunctionsMutex.unlock();
+
+		for (void (*compactFunction)(void) : _compactFunctions) {
+			compactFunction();
+		}
+	}
+
+private:
+	static void _registerPool(void (*compactFunction)(void)) {
+		compactFunctionsMutex.lock();
+		compactFunctions.push_back(compactFunction);
+		compactFunctionsMutex.unlock();
+	}
+};
+
+
+// Fixed size blocks for objects of type T, handed out from slabs and reused through a freelist.
+// The pool grows to the peak number of live objects; compact() gives back the slabs that are entirely free again.
+// Each thread keeps a few free blocks of its own, so allocating and freeing in turn doesn't take the mutex; they move between
+// the threads and the shared freelist in batches.
+template <typename T>
+class ObjectPool {
+private:
+	union Slot {
+		Slot * next;
+		alignas(T) unsigned char storage[sizeof(T)];
+	};
+
+	static constexpr std::size_t slotsPerSlab = 64;
+	static constexpr std::size_t threadCacheSize = 32; 	// Half of it is handed back once a thread holds more than this.
+
+	static inline Slot * freeList = nullptr;
+	static inline std::size_t slotCount = 0;
+	static inline std::size_t slotsInUse = 0; 	// Taken from the shared freelist; includes those in the thread caches.
+	static inline std::vector<Slot *> slabs; 	// Only to find them back when compacting; see _addSlab().
+	static inline std::mutex freeListMutex;
+
+	// Trivially destructible, so it stays usable while the thread's other thread_local objects are destroyed.
+	struct ThreadCache {
+		Slot * freeList = nullptr;
+		std::size_t slotCount = 0;
+		bool closed = false; 	// The thread is exiting and handed its slots back; go to the shared freelist from now on.
+	};
+	static inline thread_local ThreadCache threadCache;
+
+	struct ThreadCacheCloser {
+		~ThreadCacheCloser() {
+			_giveBack(threadCache.slotCount);
+			threadCache.closed = true;
+		}
+	};
+	static inline thread_local ThreadCacheCloser threadCacheCloser;
+
+public:
+	static void * allocate() {
+		ThreadCache & _threadCache = threadCache;
+		if (_threadCache.freeList == nullptr) {
+			if (_threadCache.closed) {
+				return _allocateShared();
+			}
+			_take(threadCacheSize / 2);
+		}
+		Slot * slot = _threadCache.freeList;
+		_threadCache.freeList = slot->next;
+		_threadCache.slotCount--;
+
+		return slot->storage;
+	}
+
+	static void deallocate(void * pointer) {
+		Slot * slot = reinterpret_cast<Slot *>(pointer);
+
+		(void)&threadCacheCloser; 	// A thread that only ever frees still caches blocks; those too go back when it exits.
+		ThreadCache & _threadCache = threadCache;
+		if (_threadCache.closed) {
+			_deallocateShared(slot);
+			return;
+		}
+		slot->next = _threadCache.freeList;
+		_threadCache.freeList = slot;
+		_threadCache.slotCount++;
+		if (_threadCache.slotCount > threadCacheSize) {
+			_giveBack(threadCacheSize / 2);
+		}
+	}
+
+	static std::size_t getMemoryFootprint() {
+		freeListMutex.lock();
+		std::size_t footprint = slotCount * sizeof(Slot);
+		freeListMutex.unlock();
+		return footprint;
+	}
+
+	// Deletes the slabs of which every block is back on the shared freelist, after handing back this thread's cache. Blocks
+	// cached by other threads keep their slabs.
+	static void compact() {
+		if (!threadCache.closed) {
+			_giveBack(threadCache.slotCount);
+		}
+
+		freeListMutex.lock();
+		std::sort(slabs.begin(), slabs.end(), std::less<Slot *>());
+		std::vector<std::size_t> freeSlotCounts(slabs.size(), 0);
+		for (Slot * slot = freeList; slot != nullptr; slot = slot->next) {
+			freeSlotCounts[_findSlab(slot)]++;
+		}
+
+		// Take the blocks of the free slabs off the freelist, then the slabs themselves.
+		Slot ** link = &freeList;
+		while (*link != nullptr) {
+			if (freeSlotCounts[_findSlab(*link)] == slotsPerSlab) {
+				*link = (*link)->next;
+			} else {
+				link = &(*link)->next;
+			}
+		}
+		std::size_t keptSlabCount = 0;
+		for (std::size_t i = 0; i < slabs.size(); i++) {
+			if (freeSlotCounts[i] == slotsPerSlab) {
+				delete[] slabs[i];
+			} else {
+				slabs[keptSlabCount++] = slabs[i];
+			}
+		}
+		std::size_t freedSlabCount = slabs.size() - keptSlabCount;
+		slabs.resize(keptSlabCount);
+		slotCount -= freedSlabCount * slotsPerSlab;
+		ObjectPools::slabCount.fetch_sub(freedSlabCount, std::memory_order_relaxed);
+		ObjectPools::slabBytes.fetch_sub(freedSlabCount * slotsPerSlab * sizeof(Slot), std::memory_order_relaxed);
+		freeListMutex.unlock();
+	}
+
+	static std::size_t getSlotsInUse() {
+		freeListMutex.lock();
+		std::size_t _slotsInUse = slotsInUse;
+		freeListMutex.unlock();
+		return _slotsInUse;
+	}
+
+private:
+	// Moves 'count' slots from the shared freelist to this thread's cache.
+	static void _take(std::size_t count) {
+		(void)&threadCacheCloser; 	// Gives the cache back when the thread exits.
+
+		freeListMutex.lock(); 	// Blocks come back from whichever thread drops the last reference; so mutex it.
+		for (std::size_t i = 0; i < count; i++) {
+			if (freeList == nullptr) {
+				_addSlab();
+			}
+			Slot * slot = freeList;
+			freeList = slot->next;
+			slot->next = threadCache.freeList;
+			threadCache.freeList = slot;
+		}
+		slotsInUse += count;
+		freeListMutex.unlock();
+		threadCache.slotCount += count;
+	}
+
+	// Moves 'count' slots from this thread's cache to the shared freelist.
+	static void _giveBack(std::size_t count) {
+		if (count == 0) {
+			return;
+		}
+		Slot * first = threadCache.freeList;
+		Slot * last = first;
+		for (std::size_t i = 1; i < count; i++) {
+			last = last->next;
+		}
+		threadCache.freeList = last->next;
+		threadCache.slotCount -= count;
+
+		freeListMutex.lock();
+		last->next = freeList;
+		freeList = first;
+		slotsInUse -= count;
+		freeListMutex.unlock();
+	}
+
+	static void * _allocateShared() {
+		freeListMutex.lock();
+		if (freeList == nullptr) {
+			_addSlab();
+		}
+		Slot * slot = freeList;
+		freeList = slot->next;
+		slotsInUse++;
+		freeListMutex.unlock();
+
+		return slot->storage;
+	}
+
+	static void _deallocateShared(Slot * slot) {
+		freeListMutex.lock();
+		slot->next = freeList;
+		freeList = slot;
+		slotsInUse--;
+		freeListMutex.unlock();
+	}
+
+	static void _addSlab() {
+		static bool registered = (ObjectPools::_registerPool(&ObjectPool<T>::compact), true);
+		(void)registered;
+
+		// Not owned by anything on purpose: blocks may still be handed back during static destruction.
+		Slot * slab = new Slot[slotsPerSlab];
+		for (std::size_t i = 0; i < slotsPerSlab; i++) {
+			slab[i].next = (i + 1 < slotsPerSlab) ? &slab[i + 1] : freeList;
+		}
+		freeList = slab;
+		slabs.push_back(slab);
+		slotCount += slotsPerSlab;
+		ObjectPools::slabCount.fetch_add(1, std::memory_order_relaxed);
+		ObjectPools::slabBytes.fetch_add(slotsPerSlab * sizeof(Slot), std::memory_order_relaxed);
+	}
+
+	// Index in 'slabs', sorted, of the slab holding 'slot'.
+	static std::size_t _findSlab(const Slot * slot) {
+		auto slabIterator = std::upper_bound(slabs.begin(), slabs.end(), slot, std::less<const Slot *>());
+		return static_cast<std::size_t>(slabIterator - slabs.begin()) - 1;
+	}
+};
+
+
+// Allocator handing single objects out of ObjectPool<T>; meant for std::allocate_shared, which rebinds it to its own control block type.
+template <typename T>
+class PoolAllocator {
+public:
+	typedef T value_type;
+
+	PoolAllocator() noexcept {}
+
+	template<typename U>
+	PoolAllocator(const PoolAllocator<U> &) noexcept {}
+
+	T * allocate(std::size_t n) {
+		if (n == 1) {
+			return static_cast<T *>(ObjectPool<T>::allocate());
+		}
+		return static_cast<T *>(::operator new(n * sizeof(T)));
+	}
+
+	void deallocate(T * pointer, std::size_t n) noexcept {
+		if (n == 1) {
+			ObjectPool<T>::deallocate(pointer);
+		} else {
+			::operator delete(pointer);
+		}
+	}
+
+	template<typename U>
+	bool operator==(const PoolAllocator<U> &) const noexcept {
+		return true;
+	}
+};
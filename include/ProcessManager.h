@@ -1,37 +1,72 @@
 #pragma once
 
+#include "EventTypeRegistry.h"
+
 #include <vector>
 #include <mutex>
 #include <functional>
+#include <atomic>
+#include <cstdint>
 
 
 class ProcessManager {
 private:
 	static inline std::vector<std::function<void(void)>> processRequests;
 	static inline std::mutex processRequestsMutex;
+	static inline std::atomic<std::uint64_t> contendedProcessRequestsLocks{0};
 
 	static inline std::function<void(void)> idleFunction;
 	static inline std::mutex idleFunctionMutex;
 
+	// Per thread; only the thread handling the process requests touches these.
+	static inline thread_local std::vector<std::function<void(void)>> passEndRequests;
+	static inline thread_local std::vector<std::function<void(void)>> spareProcessRequests; 	// Swapped in for 'processRequests' each drain, so neither loses its capacity.
+	static inline thread_local std::vector<std::function<void(void)>> sparePassEndRequests;
+	static inline thread_local bool handlingProcessRequests = false;
+
 
 public:
 	template<typename Func, typename... Bindables>
 	static void requestProcess(Func func, Bindables... bindables) {
 		// Bind the arguments to make a simple void(void) function call; doing this here because most uses of this function will force the use of bind anyway.
-		std::function<void(void)> callbackFunction = std::bind(func, bindables...);
-		
+		std::function<void(void)> callbackFunction;
+		if constexpr (sizeof...(Bindables) == 0) {
+			callbackFunction = std::move(func); 	// Nothing to bind; a small, trivially copyable callable is stored inline by std::function.
+		} else {
+			callbackFunction = std::bind(std::move(func), std::move(bindables)...);
+		}
+
 		// Store the request process.
-		processRequestsMutex.lock(); 	//Anything dealing with 'processRequests' is protected by a mutex.
-		processRequests.push_back(callbackFunction);
+		_lockProcessRequests(); 	//Anything dealing with 'processRequests' is protected by a mutex.
+		processRequests.push_back(std::move(callbackFunction));
 		processRequestsMutex.unlock();
 	}
 
+	// Runs on the calling thread once the process requests taken in the current pass are handled, before the next pass takes the
+	// ones requested meanwhile; meant to be called from within a process. Unlike the end of the drain, this comes under steady load
+	// too.
+	template<typename Func, typename... Bindables>
+	static void requestProcessAtPassEnd(Func func, Bindables... bindables) {
+		passEndRequests.push_back(std::bind(func, bindables...));
+	}
+
+	static bool isHandlingProcessRequests() {
+		return handlingProcessRequests;
+	}
+
 	static void handleProcessRequests() {
+		handlingProcessRequests = true;
+
+		// Take the spare buffers; a nested call finds them empty and simply allocates its own.
+		std::vector<std::function<void(void)>> _processRequests;
+		std::vector<std::function<void(void)>> _passEndRequests;
+		std::swap(spareProcessRequests, _processRequests);
+		std::swap(sparePassEndRequests, _passEndRequests);
+
 		// Handle all process requests.
-		processRequestsMutex.lock(); 	//anything dealing with 'processRequests' is protected by a mutex.
-		while (!processRequests.empty()) {
+		_lockProcessRequests(); 	//anything dealing with 'processRequests' is protected by a mutex.
+		while (!processRequests.empty() || !passEndRequests.empty()) {
 			// Make a copy so we don't have to deal with the "what if a called process calls requestProcess"-case (cause it most likely will occur a lot).
-			std::vector<std::function<void(void)>> _processRequests;
 			std::swap(processRequests, _processRequests);
 			processRequestsMutex.unlock();
 
@@ -39,9 +74,25 @@ public:
 			for (auto & _processRequest : _processRequests) {
 				_processRequest();
 			}
-			processRequestsMutex.lock(); 	//anything dealing with 'processRequests' is protected by a mutex.
+			_processRequests.clear();
+
+			// End of the pass; these may request new processes, hence the loop.
+			_runRequests(passEndRequests, _passEndRequests);
+			_lockProcessRequests(); 	//anything dealing with 'processRequests' is protected by a mutex.
 		}
 		processRequestsMutex.unlock();
+
+		std::swap(spareProcessRequests, _processRequests);
+		std::swap(sparePassEndRequests, _passEndRequests);
+
+		handlingProcessRequests = false;
+	}
+
+	static bool processRequestsPending() {
+		_lockProcessRequests(); 	//anything dealing with 'processRequests' is protected by a mutex.
+		bool pending = !processRequests.empty();
+		processRequestsMutex.unlock();
+		return pending;
 	}
 
 	static void callIdleFunction() {
@@ -55,14 +106,41 @@ public:
 	}
 
 	static void run() {
+		bool busy = processRequestsPending();
 		handleProcessRequests();
+		if (busy) {
+			EventTypeRegistry::notifyBusy();
+		} else {
+			EventTypeRegistry::notifyIdle();
+		}
 		callIdleFunction();
 	}
 
+	// Number of times taking the process request lock had to wait for another thread.
+	static std::uint64_t getContendedLockCount() {
+		return contendedProcessRequestsLocks.load(std::memory_order_relaxed);
+	}
+
 	static void setIdleFunction(std::function<void(void)> idleFunction) {
 		idleFunctionMutex.lock(); 	//I doubt the assignment operator of a function is atomic, so mutex it.
 		ProcessManager::idleFunction = idleFunction;
 		idleFunctionMutex.unlock();
 	}
 
+private:
+	// Swaps 'requests' with the empty '_requests' and runs them; whatever they request meanwhile lands in 'requests' again.
+	static void _runRequests(std::vector<std::function<void(void)>> & requests, std::vector<std::function<void(void)>> & _requests) {
+		std::swap(requests, _requests);
+		for (auto & _request : _requests) {
+			_request();
+		}
+		_requests.clear();
+	}
+
+	static void _lockProcessRequests() {
+		if (!processRequestsMutex.try_lock()) {
+			contendedProcessRequestsLocks.fetch_add(1, std::memory_order_relaxed);
+			processRequestsMutex.lock();
+		}
+	}
 };
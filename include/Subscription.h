@@ -1,74 +1,129 @@
 #pragma once
 
+#include "EventLoop.h"
+#include "EventTracer.h"
+
 #include <functional>
+#include <memory>
+#include <optional>
 #include <mutex>
+#include <typeinfo>
+#include <atomic>
 
 
 template <typename T>
 class Subscription {
 private:
 	std::function<void(T&)> subscriberFunction;
-	unsigned int subscriptionHandles;
-	std::mutex subscriptionHandlesMutex;
+	std::atomic<unsigned int> subscriptionHandles;
 
 	std::recursive_mutex deletionDelayMutex;
-	bool subscribed;
+	std::atomic<bool> valid; 	// Mirrors whether 'subscriberFunction' is set; readable without taking 'deletionDelayMutex'.
+	std::atomic<bool> subscribed; 	// Flipped by handles on any thread while the event managing thread reads it.
+
+	std::weak_ptr<EventLoopInbox> eventLoopInbox; 	// Of the loop the subscriber lives on; expires with that loop.
+	bool onEventLoop; 	// false means it is called directly from whoever manages the event.
 
-	Subscription() {
+	Subscription() :
+			valid(false),
+			subscribed(false),
+			onEventLoop(false)
+	{
 		//dummy subscription.
 	}
 
 public:
 	static inline Subscription<T> DummySubscription;
 
-	Subscription(std::function<void(T&)> subscriberFunction) :
+	virtual ~Subscription() {}
+
+	Subscription(std::function<void(T&)> subscriberFunction, std::weak_ptr<EventLoopInbox> eventLoopInbox = EventLoop::currentInbox()) :
 			subscriberFunction(subscriberFunction),
 			subscriptionHandles(0),
-			subscribed(true)
+			valid(!!subscriberFunction),
+			subscribed(true),
+			eventLoopInbox(eventLoopInbox),
+			onEventLoop(!eventLoopInbox.expired())
 	{
 
 	}
 
+	bool isOnEventLoop() const {
+		return onEventLoop;
+	}
+
+	const std::weak_ptr<EventLoopInbox> & getEventLoopInbox() const {
+		return eventLoopInbox;
+	}
+
 	void incrementSubscriptionHandles() {
-		subscriptionHandlesMutex.lock();
-		subscriptionHandles++;
-		subscriptionHandlesMutex.unlock();
+		subscriptionHandles.fetch_add(1, std::memory_order_relaxed);
 	}
 
 	void decrementSubscriptionHandles() {
-		subscriptionHandlesMutex.lock();
-		subscriptionHandles--;
-		auto _subscriptionHandles = subscriptionHandles;
-		subscriptionHandlesMutex.unlock();
-
-		if (_subscriptionHandles == 0) {
+		if (subscriptionHandles.fetch_sub(1, std::memory_order_acq_rel) == 1) {
 			invalidate();
 		}
 	}
 
 	void invalidate() {
 		deletionDelayMutex.lock();
+		valid.store(false, std::memory_order_release);
 		subscriberFunction = std::function<void(T&)>();
+		releaseSubscriber();
 		deletionDelayMutex.unlock();
 	}
 
-	bool isValid() {
-		return !!subscriberFunction;
+	bool isValid() const {
+		return valid.load(std::memory_order_acquire);
 	}
 
 	void call(T & event) {
 		deletionDelayMutex.lock();
-		if (isValid() && subscribed) {
+		if (isValid() && subscribed.load(std::memory_order_relaxed)) {
+			EVENT_TRACE_SCOPE("handler", typeid(T).name(), EventTracer::getCurrentFlowID());
 			subscriberFunction(event);
 		}
 		deletionDelayMutex.unlock();
 	}
 
 	void unsubscribe() {
-		subscribed = false;
+		subscribed.store(false, std::memory_order_relaxed);
 	}
 
 	void resubscribe() {
-		subscribed = true;
+		subscribed.store(true, std::memory_order_relaxed);
+	}
+
+protected:
+	// Lets go of whatever the subscriber function referred to; called with 'deletionDelayMutex' held once it is invalidated.
+	virtual void releaseSubscriber() {}
+
+	void setSubscriberFunction(std::function<void(T&)> subscriberFunction) {
+		deletionDelayMutex.lock();
+		this->subscriberFunction = subscriberFunction;
+		valid.store(!!this->subscriberFunction, std::memory_order_release);
+		deletionDelayMutex.unlock();
+	}
+};
+
+// Subscription that keeps the bound callback inline, next to itself; the std::function only refers to it, so it fits the small buffer and does not allocate.
+template <typename T, typename Callable>
+class BoundSubscription : public Subscription<T> {
+private:
+	std::optional<Callable> callable; 	// Destroyed on invalidation, along with what it captured; the block itself is freed later.
+
+public:
+	BoundSubscription(Callable boundCallable, std::weak_ptr<EventLoopInbox> eventLoopInbox = EventLoop::currentInbox()) :
+			Subscription<T>(std::function<void(T&)>(), std::move(eventLoopInbox)),
+			callable(std::move(boundCallable))
+	{
+		Callable * callablePointer = &*callable;
+		this->setSubscriberFunction([callablePointer](T & event){ (*callablePointer)(event); });
+	}
+
+protected:
+	void releaseSubscriber() override {
+		callable.reset();
 	}
 };
@@ -3,9 +3,16 @@
 #include "Subscription.h"
 
 #include <memory>
+#include <span>
+#include <utility>
+
+template <typename T>
+class UniqueSubscriptionHandle;
 
 template <typename T>
 class SubscriptionHandle {
+	friend class UniqueSubscriptionHandle<T>;
+
 private:
 	// Subscription<T> & subscription;
 	std::weak_ptr<Subscription<T>> subscription_wp;
@@ -44,9 +51,25 @@ public:
 		}
 	}
 
+	// Takes over the other handle's count on the subscription; the subscription itself isn't touched.
+	SubscriptionHandle(SubscriptionHandle<T> && other) noexcept :
+			subscription_wp(std::move(other.subscription_wp))
+	{
+	}
+
 	SubscriptionHandle<T> & operator=(const SubscriptionHandle<T> & rhs) {
-		this->~SubscriptionHandle<T>();
-		new (this) SubscriptionHandle<T>(rhs);
+		if (this != &rhs) {
+			SubscriptionHandle<T> _rhs(rhs);
+			std::swap(subscription_wp, _rhs.subscription_wp); 	// '_rhs' lets go of what this handle held.
+		}
+		return *this;
+	}
+
+	SubscriptionHandle<T> & operator=(SubscriptionHandle<T> && rhs) noexcept {
+		if (this != &rhs) {
+			SubscriptionHandle<T> _rhs(std::move(rhs));
+			std::swap(subscription_wp, _rhs.subscription_wp);
+		}
 		return *this;
 	}
 
@@ -63,6 +86,73 @@ public:
 			subscription_sp->resubscribe();
 		}
 	}
+
+private:
+	// Hands this handle's count on the subscription over to the caller; the handle is empty afterwards.
+	std::shared_ptr<Subscription<T>> release() {
+		std::shared_ptr<Subscription<T>> subscription_sp = subscription_wp.lock();
+		subscription_wp.reset();
+		return subscription_sp;
+	}
+};
+
+// Move-only handle that keeps the subscription itself rather than a weak reference to it. Moving it touches nothing shared,
+// and unsubscribe()/resubscribe() are a single flag flip that the event managing thread picks up on its next call.
+// Made from any SubscriptionHandle, e.g.:
+//
+//	UniqueSubscriptionHandle<InputEvent> handle = EventManager<InputEvent>::subscribe(&Receiver::receiveEvent, this);
+template <typename T>
+class UniqueSubscriptionHandle {
+private:
+	std::shared_ptr<Subscription<T>> subscription_sp; 	// Holds one of the subscription's handle counts, like a SubscriptionHandle.
+
+public:
+	UniqueSubscriptionHandle() {} 	// An invalid subscription.
+
+	UniqueSubscriptionHandle(SubscriptionHandle<T> && subscriptionHandle) :
+			subscription_sp(subscriptionHandle.release())
+	{
+	}
+
+	UniqueSubscriptionHandle(const UniqueSubscriptionHandle<T> & other) = delete;
+	UniqueSubscriptionHandle<T> & operator=(const UniqueSubscriptionHandle<T> & rhs) = delete;
+
+	UniqueSubscriptionHandle(UniqueSubscriptionHandle<T> && other) noexcept :
+			subscription_sp(std::move(other.subscription_sp))
+	{
+	}
+
+	UniqueSubscriptionHandle<T> & operator=(UniqueSubscriptionHandle<T> && rhs) noexcept {
+		if (this != &rhs) {
+			reset();
+			subscription_sp = std::move(rhs.subscription_sp);
+		}
+		return *this;
+	}
+
+	~UniqueSubscriptionHandle() {
+		reset();
+	}
+
+	// Lets go of the subscription; it is invalidated if no other handle has it.
+	void reset() {
+		if (subscription_sp) {
+			subscription_sp->decrementSubscriptionHandles();
+			subscription_sp.reset();
+		}
+	}
+
+	void unsubscribe() {
+		if (subscription_sp) {
+			subscription_sp->unsubscribe();
+		}
+	}
+
+	void resubscribe() {
+		if (subscription_sp) {
+			subscription_sp->resubscribe();
+		}
+	}
 };
 
 template <typename T>
@@ -81,7 +171,12 @@ public:
 	}
 
 	KeyedSubscriptionHandle(const KeyedSubscriptionHandle<T> & other) :
-			subscriptionHandle(other)
+			subscriptionHandle(other.subscriptionHandle)
+	{
+	}
+
+	KeyedSubscriptionHandle(KeyedSubscriptionHandle<T> && other) noexcept :
+			subscriptionHandle(std::move(other.subscriptionHandle))
 	{
 	}
 
@@ -90,6 +185,11 @@ public:
 		return *this;
 	}
 
+	KeyedSubscriptionHandle<T> & operator=(KeyedSubscriptionHandle<T> && rhs) noexcept {
+		this->subscriptionHandle = std::move(rhs.subscriptionHandle);
+		return *this;
+	}
+
 	void unsubscribe() {
 		subscriptionHandle.unsubscribe();
 	}
@@ -98,3 +198,7 @@ public:
 		subscriptionHandle.resubscribe();
 	}
 };
+
+// Handle for a subscription receiving all events of a pass or phase run at once; see EventManager<T>::subscribeBatch().
+template <typename T>
+using BatchSubscriptionHandle = SubscriptionHandle<std::span<const T>>;
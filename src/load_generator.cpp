@@ -0,0 +1,255 @@
+#include "EventManager.h"
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cstdint>
+
+// Load generator: M producer threads publish plain, keyed and phased events while one consumer drives ProcessManager::run()
+// and a churn thread subscribes/unsubscribes at random. Reports throughput, publish-to-handler latency and lock contention per M.
+// There is one consumer because ProcessManager::run() must not be called from several threads at once: the EventManager<T>
+// subscription lists it works on are only ever touched by the thread managing events.
+//
+// Usage: event_handling_load [maxProducers=8] [millisecondsPerStep=1000]
+
+typedef std::chrono::steady_clock Clock;
+
+static std::uint64_t now() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+}
+
+template <unsigned int Channel>
+class LoadEvent {
+private:
+	std::uint64_t publishTime;
+	unsigned int payload;
+
+public:
+	LoadEvent(unsigned int payload) :
+			publishTime(now()),
+			payload(payload)
+	{
+		// do nothing
+	}
+
+	std::uint64_t getPublishTime() const {
+		return publishTime;
+	}
+
+	unsigned int getPayload() const {
+		return payload;
+	}
+};
+
+typedef LoadEvent<0> PlainLoadEvent;
+typedef LoadEvent<1> KeyedLoadEvent;
+typedef LoadEvent<2> PhasedLoadEvent;
+
+enum LoadPhases_e {
+	e_LoadPhase
+};
+
+static constexpr unsigned int keyCount = 64;
+static constexpr std::int64_t maxOutstandingEvents = 4096; 	// Producers back off beyond this, so the queues don't grow without bound.
+static constexpr std::size_t maxChurnSubscriptions = 32; 	// Per event type; keeps churn from turning into fan-out.
+
+static std::atomic<std::int64_t> outstandingEvents(0);
+static std::atomic<std::uint64_t> publishedEvents(0);
+static std::atomic<bool> producing(false);
+
+
+// Sees every event once; only ever called from the consumer thread.
+class LoadStatistics {
+private:
+	std::vector<std::uint64_t> latencies;
+	std::uint64_t churnCalls;
+
+public:
+	LoadStatistics() :
+			churnCalls(0)
+	{
+	}
+
+	template <typename EventType>
+	void receiveEvent(EventType & event) {
+		latencies.push_back(now() - event.getPublishTime());
+		outstandingEvents.fetch_sub(1, std::memory_order_relaxed);
+	}
+
+	void receiveChurnCall() {
+		churnCalls++;
+	}
+
+	void reset() {
+		latencies.clear();
+		churnCalls = 0;
+	}
+
+	std::size_t getEventCount() const {
+		return latencies.size();
+	}
+
+	std::uint64_t getChurnCalls() const {
+		return churnCalls;
+	}
+
+	double getLatencyPercentile(double percentile) {
+		if (latencies.empty()) {
+			return 0.0;
+		}
+		std::size_t index = std::min(latencies.size() - 1, static_cast<std::size_t>(percentile / 100.0 * latencies.size()));
+		std::nth_element(latencies.begin(), latencies.begin() + index, latencies.end());
+		return latencies[index] / 1000.0;
+	}
+};
+
+static LoadStatistics statistics;
+
+// Keys are interned once up front, like a real publisher would; producers and the churn thread only pass KeyIds.
+static std::vector<KeyId> keyIds;
+
+template <typename EventType>
+static void receiveChurnEvent(EventType & event) {
+	statistics.receiveChurnCall();
+}
+
+
+static void produce(unsigned int seed) {
+	std::mt19937 random(seed);
+	std::uniform_int_distribution<unsigned int> operationDistribution(0, 9);
+	std::uniform_int_distribution<unsigned int> keyDistribution(0, keyCount - 1);
+
+	while (producing.load(std::memory_order_relaxed)) {
+		if (outstandingEvents.load(std::memory_order_relaxed) >= maxOutstandingEvents) {
+			std::this_thread::yield();
+			continue;
+		}
+
+		unsigned int operation = operationDistribution(random);
+		outstandingEvents.fetch_add(1, std::memory_order_relaxed);
+		if (operation < 4) {
+			EventManager<PlainLoadEvent>::addEvent(operation);
+		} else if (operation < 7) {
+			EventManager<KeyedLoadEvent>::addKeyedEvent(keyIds[keyDistribution(random)], operation);
+		} else {
+			EventManager<PhasedLoadEvent>::addPhasedEvent(e_LoadPhase, (operation == 9) ? NEXT : NOW, operation);
+		}
+		publishedEvents.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+static void churn(unsigned int seed) {
+	std::mt19937 random(seed);
+	std::uniform_int_distribution<unsigned int> operationDistribution(0, 4);
+	std::uniform_int_distribution<unsigned int> keyDistribution(0, keyCount - 1);
+
+	std::vector<UniqueSubscriptionHandle<PlainLoadEvent>> plainHandles;
+	std::vector<UniqueSubscriptionHandle<KeyedLoadEvent>> keyedHandles;
+
+	while (producing.load(std::memory_order_relaxed)) {
+		unsigned int operation = operationDistribution(random);
+		bool keyed = (random() % 2) == 0;
+		std::size_t handleCount = keyed ? keyedHandles.size() : plainHandles.size();
+		std::size_t index = (handleCount > 0) ? (random() % handleCount) : 0;
+
+		if (operation <= 1 || handleCount == 0) {
+			// Subscribe.
+			if (handleCount < maxChurnSubscriptions) {
+				if (keyed) {
+					keyedHandles.push_back(EventManager<KeyedLoadEvent>::keyedSubscribe(&receiveChurnEvent<KeyedLoadEvent>, keyIds[keyDistribution(random)]));
+				} else {
+					plainHandles.push_back(EventManager<PlainLoadEvent>::subscribe(&receiveChurnEvent<PlainLoadEvent>));
+				}
+			}
+		} else if (operation == 2) {
+			// Drop a subscription.
+			if (keyed) {
+				std::swap(keyedHandles[index], keyedHandles.back());
+				keyedHandles.pop_back();
+			} else {
+				std::swap(plainHandles[index], plainHandles.back());
+				plainHandles.pop_back();
+			}
+		} else if (operation == 3) {
+			keyed ? keyedHandles[index].unsubscribe() : plainHandles[index].unsubscribe();
+		} else {
+			keyed ? keyedHandles[index].resubscribe() : plainHandles[index].resubscribe();
+		}
+
+		std::this_thread::sleep_for(std::chrono::microseconds(50));
+	}
+}
+
+static void runStep(unsigned int producerCount, std::chrono::milliseconds duration) {
+	statistics.reset();
+	publishedEvents = 0;
+	std::uint64_t contendedLocksBefore = ProcessManager::getContendedLockCount() + PhaseManager::getContendedLockCount();
+
+	producing = true;
+	std::vector<std::thread> producers;
+	for (unsigned int i = 0; i < producerCount; i++) {
+		producers.emplace_back(&produce, 1000 + i);
+	}
+	std::thread churner(&churn, 42);
+
+	// Consume on this thread until the step is over.
+	Clock::time_point start = Clock::now();
+	while (Clock::now() - start < duration) {
+		PhaseManager::queuePhase(e_LoadPhase);
+		ProcessManager::run();
+	}
+
+	producing = false;
+	for (std::thread & producer : producers) {
+		producer.join();
+	}
+	churner.join();
+
+	// Drain whatever is still queued; delayed phased events need one more phase run.
+	while (outstandingEvents.load() > 0) {
+		PhaseManager::queuePhase(e_LoadPhase);
+		ProcessManager::run();
+	}
+	double elapsedSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+	std::uint64_t contendedLocks = ProcessManager::getContendedLockCount() + PhaseManager::getContendedLockCount() - contendedLocksBefore;
+
+	std::cout << std::setw(9) << producerCount
+			<< std::setw(12) << publishedEvents.load()
+			<< std::setw(14) << std::fixed << std::setprecision(0) << (statistics.getEventCount() / elapsedSeconds)
+			<< std::setw(10) << std::setprecision(1) << statistics.getLatencyPercentile(50.0)
+			<< std::setw(10) << statistics.getLatencyPercentile(99.0)
+			<< std::setw(10) << statistics.getLatencyPercentile(99.9)
+			<< std::setw(12) << statistics.getLatencyPercentile(100.0)
+			<< std::setw(12) << contendedLocks
+			<< std::setw(12) << statistics.getChurnCalls()
+			<< std::endl;
+}
+
+
+int main(int argc, char ** argv) {
+	unsigned int maxProducers = (argc > 1) ? std::stoul(argv[1]) : 8;
+	std::chrono::milliseconds stepDuration((argc > 2) ? std::stoul(argv[2]) : 1000);
+
+	for (unsigned int key = 0; key < keyCount; key++) {
+		keyIds.push_back(KeyRegistry::intern(key));
+	}
+
+	// Permanent subscribers that account for every event.
+	SubscriptionHandle<PlainLoadEvent> plainHandle = EventManager<PlainLoadEvent>::subscribe(&LoadStatistics::receiveEvent<PlainLoadEvent>, &statistics);
+	SubscriptionHandle<KeyedLoadEvent> keyedHandle = EventManager<KeyedLoadEvent>::subscribe(&LoadStatistics::receiveEvent<KeyedLoadEvent>, &statistics);
+	SubscriptionHandle<PhasedLoadEvent> phasedHandle = EventManager<PhasedLoadEvent>::subscribe(&LoadStatistics::receiveEvent<PhasedLoadEvent>, &statistics);
+
+	std::cout << "producers   published      events/s   p50(us)   p99(us) p99.9(us)     max(us)   contended churn calls" << std::endl;
+	for (unsigned int producerCount = 1; producerCount <= maxProducers; producerCount *= 2) {
+		runStep(producerCount, stepDuration);
+	}
+
+	return 0;
+}
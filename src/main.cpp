@@ -1,7 +1,16 @@
 #include "EventManager.h"
+#include "EventPipeline.h"
 
 #include <iostream>
 #include <string>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <utility>
+#ifdef EVENTHANDLING_TRACING
+#include <fstream>
+#endif
 
 class InputEvent {
 private:
@@ -14,6 +23,11 @@ public:
 		// do nothing
 	}
 
+	// Lets EventPayloadPool<InputEvent> refill a recycled event and keep the string's buffer.
+	void assign(const std::string & inputString) {
+		this->inputString = inputString;
+	}
+
 	const std::string & getInputString() const {
 		return inputString;
 	}
@@ -85,6 +99,79 @@ public:
 	}
 };
 
+class ComputeEventReceiver {
+private:
+	SubscriptionHandle<ComputeEvent> subscriberHandle_computeEvent;
+public:
+	ComputeEventReceiver() :
+			subscriberHandle_computeEvent(EventManager<ComputeEvent>::subscribe(&ComputeEventReceiver::receiveEvent, this))
+	{
+
+	}
+
+	void receiveEvent(ComputeEvent event) {
+		std::cout << "CER:" << event.getX() << std::endl;
+	}
+};
+
+class FilteredComputeEventReceiver {
+private:
+	SubscriptionHandle<ComputeEvent> subscriberHandle_computeEvent;
+	int id;
+public:
+	FilteredComputeEventReceiver(const EventFilter<ComputeEvent> & filter, int id) :
+			subscriberHandle_computeEvent(EventManager<ComputeEvent>::subscribeFiltered(filter, &FilteredComputeEventReceiver::receiveEvent, this)),
+			id(id)
+	{
+
+	}
+
+	void receiveEvent(ComputeEvent event) {
+		std::cout << "FCER[" << id << "]:" << event.getX() << std::endl;
+	}
+};
+
+// Keeps the last pooled InputEvent beyond the call; the lease keeps it out of the pool.
+class LastInputEventReceiver {
+private:
+	SubscriptionHandle<InputEvent> subscriberHandle_inputEvent;
+	EventLease<InputEvent> lastEvent;
+
+public:
+	LastInputEventReceiver() :
+			subscriberHandle_inputEvent(EventManager<InputEvent>::subscribe(&LastInputEventReceiver::receiveEvent, this))
+	{
+
+	}
+
+	void receiveEvent(const InputEvent & event) {
+		lastEvent = EventManager<InputEvent>::leaseCurrentEvent();
+	}
+
+	const EventLease<InputEvent> & getLastEvent() const {
+		return lastEvent;
+	}
+};
+
+class BatchComputeEventReceiver {
+private:
+	BatchSubscriptionHandle<ComputeEvent> subscriberHandle_computeEvents;
+public:
+	BatchComputeEventReceiver() :
+			subscriberHandle_computeEvents(EventManager<ComputeEvent>::subscribeBatch(&BatchComputeEventReceiver::receiveEvents, this))
+	{
+
+	}
+
+	void receiveEvents(std::span<const ComputeEvent> events) {
+		int sum = 0;
+		for (const ComputeEvent & event : events) {
+			sum += event.getX();
+		}
+		std::cout << "BCER[" << events.size() << "]:" << sum << std::endl;
+	}
+};
+
 enum Phases_e {
 	e_Tick,
 	e_Graphics,
@@ -178,6 +265,28 @@ int main() {
 	EventManager<InputEvent>::addKeyedEvent(2, "~Hello World - shouldn't print 2!");
 	ProcessManager::run();
 
+	{
+		KeyedInputEventReceiver kier1(1);
+		KeyedInputEventReceiver kier2(2);
+
+		std::vector<std::pair<int, std::string>> burst = {
+			{1, "Burst1!"},
+			{2, "~Burst1!"},
+			{1, "Burst2!"},
+			{2, "~Burst2!"}
+		};
+		EventManager<InputEvent>::addKeyedEvents(burst); 	// Delivered grouped by key.
+		ProcessManager::run();
+	}
+
+	{
+		KeyedInputEventReceiver kier1(1);
+
+		KeyId keyId1 = KeyRegistry::intern(1); 	// Same key as the int 1; publishing with the id skips hashing the key.
+		EventManager<InputEvent>::addKeyedEvent(keyId1, "Hello KeyId!");
+		ProcessManager::run();
+	}
+
 	std::cout << "------------" << std::endl;
 
 	{
@@ -244,5 +353,166 @@ int main() {
 		ProcessManager::run();
 	}
 
+	std::cout << "------------" << std::endl;
+
+	{
+		std::atomic<bool> renderThreadReady(false);
+		std::atomic<bool> renderThreadDone(false);
+
+		std::thread renderThread([&renderThreadReady, &renderThreadDone](){
+			EventLoop renderLoop; 	// Subscriptions made on this thread from here on are delivered through 'renderLoop'.
+			InputEventReceiver ier;
+			renderThreadReady = true;
+
+			while (!renderThreadDone) {
+				renderLoop.waitForEvents(std::chrono::milliseconds(10));
+				renderLoop.run();
+			}
+			renderLoop.run();
+		});
+
+		while (!renderThreadReady) {
+			std::this_thread::yield();
+		}
+
+		EventManager<InputEvent>::addEvent("Hello render thread1!");
+		EventManager<InputEvent>::addEvent("Hello render thread2!");
+		ProcessManager::run(); 	// Both events are handed off to the render thread in one go.
+
+		renderThreadDone = true;
+		renderThread.join();
+	}
+
+	std::cout << "------------" << std::endl;
+
+	{
+		BatchComputeEventReceiver bcer;
+
+		EventManager<ComputeEvent>::addEvent(1);
+		EventManager<ComputeEvent>::addEvent(2);
+		EventManager<ComputeEvent>::addEvent(3);
+		ProcessManager::run(); 	// One batch for the whole pass.
+
+		PhaseManager::setPhaseQueueEmptyCallback(std::function<void(void)>());
+		EventManager<ComputeEvent>::addPhasedEvent(e_Graphics, NOW, 4);
+		EventManager<ComputeEvent>::addPhasedEvent(e_Graphics, NOW, 5);
+		PhaseManager::queuePhase(e_Graphics);
+		ProcessManager::run(); 	// One batch for the phase run.
+	}
+
+	std::cout << "------------" << std::endl;
+
+	{
+		InputEventReceiver ier;
+
+		PhaseManager::setPhaseEventBudget(e_UI, 2);
+		EventManager<InputEvent>::addPhasedEvent(e_UI, NOW, "Budgeted event1!");
+		EventManager<InputEvent>::addPhasedEvent(e_UI, NOW, "Budgeted event2!");
+		EventManager<InputEvent>::addPhasedEvent(e_UI, NOW, "Budgeted event3!");
+		EventManager<InputEvent>::addPhasedEvent(e_UI, NOW, "Budgeted event4!");
+		EventManager<InputEvent>::addPhasedEvent(e_UI, NEXT, "Budgeted event5 (next)!");
+
+		for (int i = 0; i < 3; i++) { 	// 4 events now, 1 next; 2 per run.
+			PhaseManager::queuePhase(e_UI);
+			ProcessManager::run();
+		}
+		std::cout << "Deferred: " << PhaseManager::getDeferredEventCount(e_UI) << std::endl;
+		PhaseManager::setPhaseEventBudget(e_UI, 0);
+	}
+
+	std::cout << "------------" << std::endl;
+
+	{
+		InputEventReceiver ier;
+
+		EventToken superseded = EventManager<InputEvent>::addEvent("Hello World - shouldn't print 3!");
+		EventManager<InputEvent>::addEvent("Hello World5!");
+		superseded.cancel();
+
+		EventToken delayed = EventManager<InputEvent>::addPhasedEvent(e_UI, 2, "Hello World - shouldn't print 4!");
+		delayed.cancel(); 	// Gone from the phase right away.
+
+		for (int i = 0; i < 3; i++) {
+			PhaseManager::queuePhase(e_UI);
+			ProcessManager::run();
+		}
+	}
+
+	std::cout << "------------" << std::endl;
+
+	{
+		InputEventReceiver ier;
+		LastInputEventReceiver lier;
+
+		EventManager<InputEvent>::addPooledEvent("Pooled event1!");
+		ProcessManager::run();
+		EventManager<InputEvent>::addPooledKeyedEvent(1, "Pooled event2!"); 	// Event1 goes back to the pool once the receiver trades its lease in.
+		ProcessManager::run();
+		std::cout << "Kept:" << lier.getLastEvent()->getInputString() << std::endl;
+	}
+
+	std::cout << "------------" << std::endl;
+
+	{
+		ComputeEventReceiver cer;
+
+		// InputEvent -> ComputeEvent holding the input's length; cer is called from within the InputEvent's dispatch.
+		SubscriptionHandle<InputEvent> pipelineHandle = EventPipeline<InputEvent>()
+				.filter([](const InputEvent & event) { return !event.getInputString().empty(); })
+				.map([](const InputEvent & event) { return static_cast<int>(event.getInputString().size()); })
+				.to<ComputeEvent>();
+
+		EventManager<InputEvent>::addEvent("");
+		EventManager<InputEvent>::addEvent("Pipelined!");
+		ProcessManager::run();
+	}
+
+	std::cout << "------------" << std::endl;
+
+	{
+		FilteredComputeEventReceiver fcer1(EventFilter<ComputeEvent>().inRange<&ComputeEvent::getX>(10, 19), 1);
+		FilteredComputeEventReceiver fcer2(EventFilter<ComputeEvent>().in<&ComputeEvent::getX>({3, 15}), 2);
+
+		EventManager<ComputeEvent>::addEvent(3);
+		EventManager<ComputeEvent>::addEvent(15);
+		EventManager<ComputeEvent>::addEvent(42); 	// Matches neither; neither is called.
+		ProcessManager::run();
+	}
+
+	std::cout << "------------" << std::endl;
+
+	{
+		std::vector<UniqueSubscriptionHandle<ComputeEvent>> handles;
+		for (int i = 0; i < 3; i++) {
+			handles.push_back(EventManager<ComputeEvent>::subscribe([i](ComputeEvent & event) {
+				std::cout << "UCER[" << i << "]:" << event.getX() << std::endl;
+			}));
+		}
+		handles[1].unsubscribe();
+		handles.erase(handles.begin()); 	// Moves the other handles down; only the first subscription goes.
+
+		EventManager<ComputeEvent>::addEvent(7);
+		ProcessManager::run();
+	}
+
+	std::cout << "------------" << std::endl;
+
+	{
+		std::cout << "Footprint before compaction: " << EventTypeRegistry::getTotalMemoryFootprint() << " bytes" << std::endl;
+		EventTypeRegistry::compactAll();
+		for (const EventTypeFootprint & footprint : EventTypeRegistry::getMemoryFootprints()) {
+			std::cout << footprint.getName() << ": " << footprint.getBytes() << " bytes" << std::endl;
+		}
+		std::cout << "Pooled: " << EventTypeRegistry::getPooledMemoryFootprint() << " bytes" << std::endl;
+		std::cout << "Footprint after compaction: " << EventTypeRegistry::getTotalMemoryFootprint() << " bytes" << std::endl;
+	}
+
+#ifdef EVENTHANDLING_TRACING
+	{
+		std::ofstream traceFile("event_trace.json");
+		EventTracer::exportChromeTrace(traceFile);
+	}
+#endif
+
 	return 0;
 }
@@ -0,0 +1,141 @@
+#undef NDEBUG
+
+#include "EventManager.h"
+#include "EventLoop.h"
+
+#include <cassert>
+#include <future>
+#include <span>
+#include <thread>
+#include <vector>
+
+
+struct PassEvent {
+	int x;
+};
+
+struct ChainEvent {
+	int step;
+};
+
+struct PhasedEvent {
+	int x;
+};
+
+struct LoopEvent {
+	int x;
+};
+
+// Events published before a pass come in one batch.
+static void testPassBatch() {
+	std::vector<std::vector<int>> batches;
+	BatchSubscriptionHandle<PassEvent> handle = EventManager<PassEvent>::subscribeBatch([&batches](std::span<const PassEvent> events) {
+		std::vector<int> batch;
+		for (const PassEvent & event : events) {
+			batch.push_back(event.x);
+		}
+		batches.push_back(batch);
+	});
+
+	EventManager<PassEvent>::addEvent(PassEvent{1});
+	EventManager<PassEvent>::addEvent(PassEvent{2});
+	EventManager<PassEvent>::addEvent(PassEvent{3});
+	ProcessManager::run();
+	assert(batches.size() == 1);
+	assert(batches[0] == std::vector<int>({1, 2, 3}));
+}
+
+// Each event publishes the next one, so the process requests never run out until the chain ends. Halfway, the batch
+// subscriber must already have had events; with one batch per drain it would get none until the chain is done.
+static void testBatchWhileRequestsKeepComing() {
+	std::size_t batchedCount = 0;
+	std::size_t batchCount = 0;
+	BatchSubscriptionHandle<ChainEvent> batchHandle = EventManager<ChainEvent>::subscribeBatch([&](std::span<const ChainEvent> events) {
+		batchedCount += events.size();
+		batchCount++;
+	});
+
+	bool batchedDuringDrain = false;
+	SubscriptionHandle<ChainEvent> chainHandle = EventManager<ChainEvent>::subscribe([&](ChainEvent & event) {
+		if (event.step == 100) {
+			batchedDuringDrain = (batchedCount > 0);
+		}
+		if (event.step < 200) {
+			EventManager<ChainEvent>::addEvent(ChainEvent{event.step + 1});
+		}
+	});
+	EventManager<ChainEvent>::addEvent(ChainEvent{0});
+	ProcessManager::run();
+	assert(batchedDuringDrain);
+	assert(batchCount > 1);
+	assert(batchedCount == 201);
+}
+
+// The events of a phase run come in one batch, at the end of that run.
+static void testPhaseRunBatch() {
+	const PhaseID phaseID = 1;
+	std::vector<int> batchSums;
+	BatchSubscriptionHandle<PhasedEvent> handle = EventManager<PhasedEvent>::subscribeBatch([&batchSums](std::span<const PhasedEvent> events) {
+		int batchSum = 0;
+		for (const PhasedEvent & event : events) {
+			batchSum += event.x;
+		}
+		batchSums.push_back(batchSum);
+	});
+
+	EventManager<PhasedEvent>::addPhasedEvent(phaseID, NOW, PhasedEvent{4});
+	EventManager<PhasedEvent>::addPhasedEvent(phaseID, NOW, PhasedEvent{5});
+	EventManager<PhasedEvent>::addPhasedEvent(phaseID, NEXT, PhasedEvent{6});
+	PhaseManager::queuePhase(phaseID);
+	ProcessManager::run();
+	assert(batchSums == std::vector<int>({9}));
+
+	PhaseManager::queuePhase(phaseID);
+	ProcessManager::run();
+	assert(batchSums == std::vector<int>({9, 6}));
+}
+
+// A batch subscriber on an event loop gets its own copy of each batch; the batch buffer is reused for the next one before
+// the loop gets around to it.
+static void testLoopCopy() {
+	std::vector<int> loopBatchSums;
+	std::promise<void> subscribed;
+	std::promise<void> published;
+	std::thread loopThread([&]() {
+		EventLoop eventLoop;
+		BatchSubscriptionHandle<LoopEvent> handle = EventManager<LoopEvent>::subscribeBatch([&loopBatchSums](std::span<const LoopEvent> events) {
+			int batchSum = 0;
+			for (const LoopEvent & event : events) {
+				batchSum += event.x;
+			}
+			loopBatchSums.push_back(batchSum);
+		});
+		subscribed.set_value();
+
+		published.get_future().wait();
+		eventLoop.run();
+	});
+	subscribed.get_future().wait();
+
+	EventManager<LoopEvent>::addEvent(LoopEvent{1});
+	EventManager<LoopEvent>::addEvent(LoopEvent{2});
+	EventManager<LoopEvent>::addEvent(LoopEvent{3});
+	ProcessManager::run();
+	EventManager<LoopEvent>::addEvent(LoopEvent{10});
+	EventManager<LoopEvent>::addEvent(LoopEvent{20});
+	ProcessManager::run();
+	published.set_value();
+	loopThread.join();
+
+	assert(loopBatchSums == std::vector<int>({6, 30}));
+}
+
+
+int main() {
+	testPassBatch();
+	testBatchWhileRequestsKeepComing();
+	testPhaseRunBatch();
+	testLoopCopy();
+
+	return 0;
+}
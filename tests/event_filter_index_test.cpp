@@ -0,0 +1,85 @@
+#undef NDEBUG
+
+#include "EventManager.h"
+#include "EventFilter.h"
+
+#include <cassert>
+#include <random>
+#include <vector>
+#include <cstddef>
+
+
+struct FilteredEvent {
+	int channel;
+	int value;
+};
+
+
+// Filtered subscriptions that never match are dropped; the index must not keep them around.
+static void testChurnWithoutMatches() {
+	int deliveredCount = 0;
+	SubscriptionHandle<FilteredEvent> liveHandle = EventManager<FilteredEvent>::subscribeFiltered(
+		EventFilter<FilteredEvent>().equals<&FilteredEvent::channel>(0),
+		[&deliveredCount](FilteredEvent &) { deliveredCount++; }
+	);
+
+	std::size_t warmedUpFootprint = 0;
+	for (int round = 0; round < 1000; round++) {
+		std::vector<SubscriptionHandle<FilteredEvent>> handles;
+		for (int i = 0; i < 100; i++) {
+			handles.push_back(EventManager<FilteredEvent>::subscribeFiltered(
+				EventFilter<FilteredEvent>().equals<&FilteredEvent::channel>(1000 + round * 100 + i),
+				[](FilteredEvent &) { assert(false); }
+			));
+		}
+		EventManager<FilteredEvent>::manageEvent(FilteredEvent{0, 0});
+		handles.clear();
+
+		if (round == 10) {
+			warmedUpFootprint = EventManager<FilteredEvent>::getMemoryFootprint();
+		} else if (round > 10) {
+			assert(EventManager<FilteredEvent>::getMemoryFootprint() <= 2 * warmedUpFootprint);
+		}
+	}
+	assert(deliveredCount == 1000);
+}
+
+struct RangedEvent {
+	int value;
+};
+
+// Range lookups find exactly the ranges holding the value, however the ranges overlap.
+static void testRanges() {
+	std::mt19937 random(42);
+	std::vector<std::pair<int, int>> ranges;
+	std::vector<int> deliveredCounts(500, 0);
+	std::vector<SubscriptionHandle<RangedEvent>> handles;
+	for (int i = 0; i < 500; i++) {
+		int low = static_cast<int>(random() % 1000);
+		int high = low + static_cast<int>(random() % ((i % 10 == 0) ? 1000 : 20));
+		ranges.emplace_back(low, high);
+		handles.push_back(EventManager<RangedEvent>::subscribeFiltered(
+			EventFilter<RangedEvent>().inRange<&RangedEvent::value>(low, high),
+			[&deliveredCounts, i](RangedEvent &) { deliveredCounts[i]++; }
+		));
+	}
+
+	std::vector<int> expectedCounts(500, 0);
+	for (int value = -10; value < 2010; value += 3) {
+		EventManager<RangedEvent>::manageEvent(RangedEvent{value});
+		for (int i = 0; i < 500; i++) {
+			if (ranges[i].first <= value && value <= ranges[i].second) {
+				expectedCounts[i]++;
+			}
+		}
+	}
+	assert(deliveredCounts == expectedCounts);
+}
+
+
+int main() {
+	testChurnWithoutMatches();
+	testRanges();
+
+	return 0;
+}
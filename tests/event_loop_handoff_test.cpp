@@ -0,0 +1,64 @@
+#undef NDEBUG
+
+#include "EventManager.h"
+#include "EventLoop.h"
+
+#include <cassert>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <thread>
+
+
+struct ChainEvent {
+	int step;
+};
+
+
+int main() {
+	std::atomic<int> loopDeliveredCount{0};
+	std::atomic<bool> stopLoop{false};
+	SubscriptionHandle<ChainEvent> loopHandle;
+	std::promise<void> subscribed;
+	std::thread loopThread([&]() {
+		EventLoop eventLoop;
+		loopHandle = EventManager<ChainEvent>::subscribe([&loopDeliveredCount](ChainEvent &) { loopDeliveredCount++; });
+		subscribed.set_value();
+		while (!stopLoop) {
+			eventLoop.waitForEvents(std::chrono::milliseconds(1));
+			eventLoop.run();
+		}
+	});
+	subscribed.get_future().wait();
+
+	// Each event publishes the next one, so the process requests never run out until the chain ends. Halfway, the loop must
+	// already have been handed events; with handoffs only at the end of the drain it would get none until the chain is done.
+	bool handedOffDuringDrain = false;
+	SubscriptionHandle<ChainEvent> chainHandle = EventManager<ChainEvent>::subscribe([&](ChainEvent & event) {
+		if (event.step == 100) {
+			std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+			while (loopDeliveredCount == 0 && std::chrono::steady_clock::now() < deadline) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+			handedOffDuringDrain = (loopDeliveredCount > 0);
+		}
+		if (event.step < 200) {
+			EventManager<ChainEvent>::addEvent(ChainEvent{event.step + 1});
+		}
+	});
+	EventManager<ChainEvent>::addEvent(ChainEvent{0});
+	ProcessManager::run();
+	assert(handedOffDuringDrain);
+
+	// Everything arrives in the end.
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+	while (loopDeliveredCount < 201 && std::chrono::steady_clock::now() < deadline) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	assert(loopDeliveredCount == 201);
+
+	stopLoop = true;
+	loopThread.join();
+
+	return 0;
+}
@@ -0,0 +1,54 @@
+#undef NDEBUG
+
+#include "EventManager.h"
+#include "EventLoop.h"
+
+#include <cassert>
+#include <atomic>
+#include <future>
+#include <memory>
+#include <thread>
+
+
+struct LoopEvent {
+	std::shared_ptr<int> payload;
+};
+
+
+int main() {
+	std::shared_ptr<int> payload = std::make_shared<int>(0);
+	std::atomic<int> deliveredCount{0};
+	SubscriptionHandle<LoopEvent> handle;
+
+	std::promise<void> subscribed;
+	std::promise<void> published;
+	std::promise<void> ran;
+	std::thread loopThread([&]() {
+		EventLoop eventLoop;
+		handle = EventManager<LoopEvent>::subscribe([&deliveredCount](LoopEvent &) { deliveredCount++; });
+		subscribed.set_value();
+
+		published.get_future().wait();
+		eventLoop.run();
+		ran.set_value();
+	});
+
+	subscribed.get_future().wait();
+	EventManager<LoopEvent>::addEvent(LoopEvent{payload});
+	ProcessManager::run();
+	published.set_value();
+	ran.get_future().wait();
+	loopThread.join();
+	assert(deliveredCount == 1);
+
+	// The loop is gone, its subscription is not; deliveries to it are dropped, staged during a drain or handed off directly.
+	EventManager<LoopEvent>::addEvent(LoopEvent{payload});
+	ProcessManager::run();
+	EventManager<LoopEvent>::manageEvent(LoopEvent{payload});
+	assert(deliveredCount == 1);
+
+	// Nothing holds on to the dropped events.
+	assert(payload.use_count() == 1);
+
+	return 0;
+}
@@ -0,0 +1,59 @@
+#undef NDEBUG
+
+#include "EventManager.h"
+#include "EventPipeline.h"
+#include "EventLoop.h"
+
+#include <cassert>
+#include <future>
+#include <thread>
+
+
+struct SourceEvent {
+	int value;
+};
+
+struct DestinationEvent {
+	int value;
+
+	DestinationEvent(int value) :
+			value(value)
+	{
+	}
+};
+
+
+int main() {
+	std::thread::id managingThread = std::this_thread::get_id();
+	int deliveredValue = 0;
+	SubscriptionHandle<DestinationEvent> destinationHandle = EventManager<DestinationEvent>::subscribe([&deliveredValue, managingThread](DestinationEvent & event) {
+		assert(std::this_thread::get_id() == managingThread);
+		deliveredValue += event.value;
+	});
+
+	// Built on a thread with a loop that never runs; the stages must not end up on that loop.
+	SubscriptionHandle<SourceEvent> pipelineHandle;
+	std::promise<void> built;
+	std::promise<void> done;
+	std::thread loopThread([&]() {
+		EventLoop eventLoop;
+		pipelineHandle = EventPipeline<SourceEvent>()
+			.filter([](const SourceEvent & event) { return event.value > 0; })
+			.map([](const SourceEvent & event) { return event.value * 10; })
+			.to<DestinationEvent>();
+		built.set_value();
+		done.get_future().wait();
+	});
+	built.get_future().wait();
+
+	EventManager<SourceEvent>::addEvent(SourceEvent{1});
+	EventManager<SourceEvent>::addEvent(SourceEvent{-1});
+	EventManager<SourceEvent>::addEvent(SourceEvent{2});
+	ProcessManager::run();
+	assert(deliveredValue == 30);
+
+	done.set_value();
+	loopThread.join();
+
+	return 0;
+}
@@ -0,0 +1,64 @@
+#undef NDEBUG
+
+#include "EventManager.h"
+#include "KeyId.h"
+
+#include <cassert>
+#include <tuple>
+#include <vector>
+
+
+struct KeyedEvent {
+	int value;
+};
+
+
+int main() {
+	int unkeyedCount = 0;
+	int keyedCount = 0;
+	SubscriptionHandle<KeyedEvent> unkeyedHandle = EventManager<KeyedEvent>::subscribe([&unkeyedCount](KeyedEvent &) { unkeyedCount++; });
+	SubscriptionHandle<KeyedEvent> keyedHandle = EventManager<KeyedEvent>::keyedSubscribe([&keyedCount](KeyedEvent &) { keyedCount++; }, 7);
+	std::size_t keyCount = KeyRegistry::getKeyCount();
+
+	// Publishing doesn't intern keys; those nobody subscribed to only reach the unkeyed subscriptions.
+	for (int key = 1000; key < 2000; key++) {
+		EventManager<KeyedEvent>::addKeyedEvent(key, key);
+		EventManager<KeyedEvent>::addPooledKeyedEvent(key, key);
+		EventManager<KeyedEvent>::addPhasedKeyedEvent(0, key, NOW, key);
+	}
+	PhaseManager::queuePhase(0);
+	ProcessManager::run();
+	assert(KeyRegistry::getKeyCount() == keyCount);
+	assert(!KeyRegistry::find(1000));
+	assert(unkeyedCount == 3000);
+	assert(keyedCount == 0);
+
+	// Subscribed keys are found, in a burst as well as on their own.
+	EventManager<KeyedEvent>::addKeyedEvent(7, 7);
+	std::vector<std::tuple<int, int>> keyedArguments{{7, 1}, {3000, 2}, {7, 3}};
+	EventManager<KeyedEvent>::addKeyedEvents(keyedArguments);
+	ProcessManager::run();
+	assert(KeyRegistry::getKeyCount() == keyCount);
+	assert(unkeyedCount == 3004);
+	assert(keyedCount == 3);
+
+	// Published before anyone subscribed to the key, but managed after someone did; the keyed subscriptions get it.
+	int lateKeyedCount = 0;
+	EventManager<KeyedEvent>::addKeyedEvent(42, 1);
+	EventManager<KeyedEvent>::addPooledKeyedEvent(42, 2);
+	std::vector<std::tuple<int, int>> lateKeyedArguments{{42, 3}, {43, 4}, {42, 5}};
+	EventManager<KeyedEvent>::addKeyedEvents(lateKeyedArguments);
+	EventManager<KeyedEvent>::addPhasedKeyedEvent(0, 43, 2, 6);
+	SubscriptionHandle<KeyedEvent> lateHandle42 = EventManager<KeyedEvent>::keyedSubscribe([&lateKeyedCount](KeyedEvent & event) { lateKeyedCount += event.value; }, 42);
+	SubscriptionHandle<KeyedEvent> lateHandle43 = EventManager<KeyedEvent>::keyedSubscribe([&lateKeyedCount](KeyedEvent & event) { lateKeyedCount += event.value; }, 43);
+	ProcessManager::run();
+	assert(lateKeyedCount == 1 + 2 + 3 + 4 + 5);
+	for (int run = 0; run < 3; run++) {
+		PhaseManager::queuePhase(0);
+		ProcessManager::run();
+	}
+	assert(lateKeyedCount == 1 + 2 + 3 + 4 + 5 + 6);
+	assert(KeyRegistry::getKeyCount() == keyCount + 2);
+
+	return 0;
+}
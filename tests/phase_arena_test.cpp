@@ -0,0 +1,89 @@
+#undef NDEBUG
+
+#include "Phase.h"
+
+#include <cassert>
+#include <array>
+#include <cstddef>
+
+
+// Schedules a cycle's worth of events, some of them for later runs, and runs the phase once.
+static void runCycle(Phase & phase, std::size_t & calledCount) {
+	std::array<std::byte, 64> payload{};
+	for (int i = 0; i < 300; i++) {
+		phase.addToQueue(i % 3, [&calledCount, payload]() { calledCount += payload.size() / 64; });
+	}
+	phase.run();
+}
+
+
+// An event far ahead doesn't make the phase hold a cycle for every run up to it, and still comes due in the right run.
+static void testFarAhead() {
+	Phase phase;
+	std::size_t calledRun = 0;
+	std::size_t runs = 0;
+	phase.addToQueue(100000, [&calledRun, &runs]() { calledRun = runs; });
+	phase.addToQueue(99999, [&calledRun, &runs]() { assert(calledRun == 0 && runs == 99999); });
+	assert(phase.getArenaCount() <= 3);
+
+	for (; runs < 100001; runs++) {
+		phase.run();
+		assert(phase.getArenaCount() <= 20);
+	}
+	assert(calledRun == 100000);
+}
+
+// Compaction gives back what a burst left in the arenas of cycles that have nothing scheduled.
+static void testCompaction() {
+	Phase phase;
+	std::array<std::byte, 256> payload{};
+	std::size_t calledCount = 0;
+	for (int i = 0; i < 1000; i++) {
+		phase.addToQueue(i % 8, [&calledCount, payload]() { calledCount += payload.size() / 256; });
+	}
+	phase.addToQueue(1, [&calledCount]() { calledCount++; });
+	std::size_t burstCapacity = phase.getArenaCapacity();
+	phase.run();
+
+	// The next run still has its events; its arena stays as it is.
+	phase.compact();
+	assert(phase.getArenaCount() == 7);
+	assert(phase.getArenaCapacity() < burstCapacity);
+	for (int run = 0; run < 7; run++) {
+		phase.run();
+	}
+	assert(calledCount == 1001);
+
+	phase.compact();
+	assert(phase.getArenaCount() == 1);
+	assert(phase.getArenaCapacity() <= 16 * 1024);
+}
+
+
+int main() {
+	testFarAhead();
+	testCompaction();
+
+	Phase phase;
+	std::size_t calledCount = 0;
+
+	// Warm up until each of the cycles in flight had its arena filled once.
+	for (int cycle = 0; cycle < 3; cycle++) {
+		runCycle(phase, calledCount);
+	}
+	std::size_t arenaCount = phase.getArenaCount();
+	std::size_t arenaCapacity = phase.getArenaCapacity();
+	assert(arenaCapacity > 0);
+
+	// Each run resets its cycle's arena and hands it on for a later cycle; nothing is allocated anew.
+	for (int cycle = 0; cycle < 1000; cycle++) {
+		runCycle(phase, calledCount);
+		assert(phase.getArenaCount() == arenaCount);
+		assert(phase.getArenaCapacity() == arenaCapacity);
+	}
+
+	// Each event was called once it came due; only those scheduled past the last run are still waiting.
+	assert(calledCount == 1003 * 300 - 200 - 100);
+
+	return 0;
+}
@@ -0,0 +1,144 @@
+#undef NDEBUG
+
+#include "Phase.h"
+
+#include <cassert>
+#include <array>
+#include <memory>
+#include <vector>
+#include <cstddef>
+#include <chrono>
+#include <thread>
+
+
+// A fixed event budget defers whatever is left, in order, and leaves the arenas as they are.
+static void testEventBudget() {
+	Phase phase;
+	phase.setEventBudget(100);
+
+	std::vector<int> calledEvents;
+	int nextEvent = 0;
+	auto addEvents = [&phase, &calledEvents, &nextEvent](int eventCount) {
+		std::array<std::byte, 64> payload{};
+		for (int i = 0; i < eventCount; i++) {
+			phase.addToQueue(NOW, [&calledEvents, event = nextEvent++, payload]() { (void)payload; calledEvents.push_back(event); });
+		}
+	};
+
+	// A backlog of 500 events, then as many events per run as the budget lets through; each run defers 500 of them.
+	addEvents(500);
+	for (int run = 0; run < 10; run++) {
+		addEvents(100);
+		phase.run();
+		assert(phase.getLastRunDeferredEventCount() == 500);
+	}
+	std::size_t arenaCount = phase.getArenaCount();
+	std::size_t arenaCapacity = phase.getArenaCapacity();
+
+	// Deferred calls move into the next cycle's arena; the arenas they leave are reset rather than carried along.
+	for (int run = 0; run < 2000; run++) {
+		addEvents(100);
+		phase.run();
+		assert(phase.getLastRunDeferredEventCount() == 500);
+		assert(phase.getArenaCount() == arenaCount);
+		assert(phase.getArenaCapacity() == arenaCapacity);
+	}
+
+	// A deferred call can still be cancelled after it moved.
+	std::shared_ptr<EventCancellationState> cancellationState = std::make_shared<EventCancellationState>();
+	bool cancelledEventCalled = false;
+	phase.addToQueue(NOW, [&cancelledEventCalled]() { cancelledEventCalled = true; }, cancellationState);
+	phase.run();
+	cancellationState->cancel();
+	assert(cancellationState->getPhaseEventNode() == nullptr);
+
+	phase.setEventBudget(0);
+	phase.run();
+	assert(!cancelledEventCalled);
+
+	// All called once, in the order they were added.
+	assert(calledEvents.size() == static_cast<std::size_t>(nextEvent));
+	for (std::size_t i = 0; i < calledEvents.size(); i++) {
+		assert(calledEvents[i] == static_cast<int>(i));
+	}
+}
+
+static void addSlowEvents(Phase & phase, std::vector<int> & calledEvents, int eventCount, std::chrono::milliseconds eventCost) {
+	for (int event = 0; event < eventCount; event++) {
+		phase.addToQueue(NOW, [&calledEvents, event, eventCost]() {
+			std::this_thread::sleep_for(eventCost);
+			calledEvents.push_back(event);
+		});
+	}
+}
+
+static void assertCalledInOrder(const std::vector<int> & calledEvents, std::size_t eventCount) {
+	assert(calledEvents.size() == eventCount);
+	for (std::size_t i = 0; i < calledEvents.size(); i++) {
+		assert(calledEvents[i] == static_cast<int>(i));
+	}
+}
+
+// A time budget stops the run once it took that long, and defers the rest.
+static void testTimeBudget() {
+	Phase phase;
+	phase.setTimeBudget(std::chrono::milliseconds(10));
+
+	std::vector<int> calledEvents;
+	addSlowEvents(phase, calledEvents, 40, std::chrono::milliseconds(2));
+	phase.run();
+	assert(!calledEvents.empty());
+	assert(calledEvents.size() <= 5);
+	assert(phase.getLastRunDeferredEventCount() == 40 - calledEvents.size());
+
+	int runs = 1;
+	while (calledEvents.size() < 40) {
+		phase.run();
+		runs++;
+	}
+	assert(runs >= 8);
+	assertCalledInOrder(calledEvents, 40);
+}
+
+// Without a measurement yet, the adaptive budget watches the clock; from then on the events per run follow from their
+// measured cost, so runs take about the target duration.
+static void testAdaptiveBudget() {
+	Phase phase;
+	phase.setAdaptiveBudget(std::chrono::milliseconds(20));
+
+	std::vector<int> calledEvents;
+	addSlowEvents(phase, calledEvents, 200, std::chrono::milliseconds(2));
+
+	// No event budget to go on yet; only the clock stops this run.
+	phase.run();
+	assert(!calledEvents.empty());
+	assert(calledEvents.size() <= 10);
+	assert(phase.getLastRunDeferredEventCount() == 200 - calledEvents.size());
+
+	// Each event takes at least 2ms, so at most 10 of them fit; once the average settled, runs take about 20ms.
+	for (int run = 0; run < 10; run++) {
+		std::size_t calledBefore = calledEvents.size();
+		std::chrono::steady_clock::time_point runStart = std::chrono::steady_clock::now();
+		phase.run();
+		std::chrono::steady_clock::duration runDuration = std::chrono::steady_clock::now() - runStart;
+		std::size_t invoked = calledEvents.size() - calledBefore;
+		assert(invoked >= 1 && invoked <= 10);
+		if (run >= 5) {
+			assert(runDuration >= std::chrono::milliseconds(10));
+			assert(runDuration <= std::chrono::milliseconds(40));
+		}
+	}
+
+	phase.setAdaptiveBudget(std::chrono::nanoseconds(0));
+	phase.run();
+	assertCalledInOrder(calledEvents, 200);
+}
+
+
+int main() {
+	testEventBudget();
+	testTimeBudget();
+	testAdaptiveBudget();
+
+	return 0;
+}
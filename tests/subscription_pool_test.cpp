@@ -0,0 +1,112 @@
+#undef NDEBUG
+
+#include "EventManager.h"
+#include "PoolAllocator.h"
+
+#include <cassert>
+#include <memory>
+#include <vector>
+#include <thread>
+
+
+struct PoolEvent {
+	int value;
+};
+
+
+// Subscribes a round of subscribers, one event, drops them, one more event to sweep them out of the subscription list.
+static void subscribeRound(int & deliveredCount) {
+	std::vector<SubscriptionHandle<PoolEvent>> handles;
+	for (int i = 0; i < 100; i++) {
+		handles.push_back(EventManager<PoolEvent>::subscribe([&deliveredCount](PoolEvent & event) { deliveredCount += event.value; }));
+	}
+	EventManager<PoolEvent>::manageEvent(PoolEvent{1});
+
+	for (SubscriptionHandle<PoolEvent> & handle : handles) {
+		handle.unsubscribe();
+	}
+	EventManager<PoolEvent>::manageEvent(PoolEvent{1});
+
+	handles.clear();
+	EventManager<PoolEvent>::manageEvent(PoolEvent{1});
+}
+
+
+// What a subscriber captured goes as soon as its last handle does, not only once its pooled block is freed.
+static void testCapturesReleased() {
+	std::shared_ptr<int> captured = std::make_shared<int>(0);
+	SubscriptionHandle<PoolEvent> handle = EventManager<PoolEvent>::subscribe([captured](PoolEvent &) {});
+	SubscriptionHandle<PoolEvent> keyedHandle = EventManager<PoolEvent>::keyedSubscribe([captured](PoolEvent &) {}, 1);
+	assert(captured.use_count() == 3);
+
+	handle = SubscriptionHandle<PoolEvent>();
+	keyedHandle = SubscriptionHandle<PoolEvent>();
+	assert(captured.use_count() == 1);
+}
+
+
+// Compaction gives back the slabs a burst of subscriptions left behind; the registry reports them meanwhile.
+static void testCompaction() {
+	std::size_t slabCount = ObjectPools::getSlabCount();
+
+	std::vector<SubscriptionHandle<PoolEvent>> handles;
+	for (int i = 0; i < 5000; i++) {
+		handles.push_back(EventManager<PoolEvent>::subscribe([](PoolEvent &) {}));
+	}
+	EventManager<PoolEvent>::manageEvent(PoolEvent{0});
+	assert(EventTypeRegistry::getPooledMemoryFootprint() >= 5000 * sizeof(Subscription<PoolEvent>));
+	assert(EventTypeRegistry::getTotalMemoryFootprint() > EventTypeRegistry::getPooledMemoryFootprint());
+
+	handles.clear();
+	EventTypeRegistry::compactAll();
+	assert(ObjectPools::getSlabCount() <= slabCount);
+}
+
+
+// A thread that only frees blocks caches them like any other; they go back to the pool when it exits.
+static void testFreeingThreads() {
+	struct Block {
+		int value;
+	};
+
+	std::size_t slotsInUse = ObjectPool<Block>::getSlotsInUse();
+	for (int round = 0; round < 100; round++) {
+		std::vector<void *> blocks;
+		for (int i = 0; i < 20; i++) {
+			blocks.push_back(ObjectPool<Block>::allocate());
+		}
+		std::thread freeingThread([&blocks]() {
+			for (void * block : blocks) {
+				ObjectPool<Block>::deallocate(block);
+			}
+		});
+		freeingThread.join();
+	}
+
+	// This thread's cache holds whatever the first round took beyond the 20 blocks; nothing was lost with the others.
+	assert(ObjectPool<Block>::getSlotsInUse() <= slotsInUse + 32);
+}
+
+
+int main() {
+	testCapturesReleased();
+	testFreeingThreads();
+
+	int deliveredCount = 0;
+
+	subscribeRound(deliveredCount);
+	assert(deliveredCount == 100);
+	std::size_t slabCount = ObjectPools::getSlabCount();
+	assert(slabCount > 0);
+
+	// Subscriptions freed by a round are reused by the next; the pools don't grow past the first round.
+	for (int round = 0; round < 1000; round++) {
+		subscribeRound(deliveredCount);
+	}
+	assert(deliveredCount == 1001 * 100);
+	assert(ObjectPools::getSlabCount() == slabCount);
+
+	testCompaction();
+
+	return 0;
+}